@@ -1,55 +1,129 @@
-// TODO: support multiple thread
-
 #include "bdd_tag.h"
 #include "debug.h"
 #include <assert.h>
+#include <cstdio>
 #include <cstring>
 #include <iostream>
+#include <new>
 #include <sstream>
 #include <stack>
 
-#define VEC_CAP (1 << 16)
 #define LB_WIDTH BDD_LB_WIDTH
 #define MAX_LB ((1 << LB_WIDTH) - 1)
 #define LB_MASK MAX_LB
 #define LEN_LB BDD_LEN_LB
 #define ROOT 0
 
+// node fields are read by threads that do not hold the writer lock
+#define LOAD(x) __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+// statistics only; a racing update may get lost, but no bus lock is paid
+#define COUNT(x)                                                               \
+  __atomic_store_n(&(x), __atomic_load_n(&(x), __ATOMIC_RELAXED) + 1,         \
+                   __ATOMIC_RELAXED)
+
 BDDTag::BDDTag() {
-  nodes.reserve(VEC_CAP);
-  nodes.push_back(TagNode(ROOT, 0, 0));
+  memset(chunks, 0, sizeof(chunks));
+  nr_nodes = 0;
+  nr_chunks = 0;
+  peak_chunks = 0;
+  version = 0;
+  PIN_MutexInit(&write_lock);
+  alloc_node(ROOT, 0, 0);
+  // an empty entry never matches, as l1 is never 0 in a lookup
+  memset(combine_cache, 0, sizeof(combine_cache));
+  memset(counters, 0, sizeof(counters));
+  gc_low = BDD_GC_LOW;
+  gc_runs = 0;
+  gc_reclaimed = 0;
+};
+
+BDDTag::~BDDTag() {
+  for (size_t i = 0; i < BDD_NR_CHUNKS; i++)
+    ::operator delete(chunks[i]);
 };
 
-BDDTag::~BDDTag(){};
+// writers hold write_lock; the version is odd while they change nodes
+void BDDTag::write_begin() {
+  PIN_MutexLock(&write_lock);
+  __atomic_store_n(&version, version + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void BDDTag::write_end() {
+  __atomic_store_n(&version, version + 1, __ATOMIC_RELEASE);
+  PIN_MutexUnlock(&write_lock);
+}
+
+// readers never wait for the lock; they check afterwards that no writer
+// ran in the meantime and go again if one did
+uint32_t BDDTag::read_begin() {
+  return __atomic_load_n(&version, __ATOMIC_ACQUIRE);
+}
 
+bool BDDTag::read_retry(uint32_t v) {
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return (v & 1) || __atomic_load_n(&version, __ATOMIC_RELAXED) != v;
+}
+
+// callers hold the writer lock; the counter and the chunk slots are
+// still updated atomically, as low_on_labels(), the statistics and the
+// readers load them without it
 lb_type BDDTag::alloc_node(lb_type parent, tag_off begin, tag_off end) {
-  lb_type lb = nodes.size();
-  if (lb < MAX_LB) {
-    nodes.push_back(TagNode(parent, begin, end));
-    return lb;
-  } else {
+  lb_type lb = __atomic_fetch_add(&nr_nodes, 1, __ATOMIC_RELAXED);
+  if (lb >= MAX_LB) {
+    // out of labels; keep the counter from wrapping around
+    __atomic_store_n(&nr_nodes, MAX_LB, __ATOMIC_RELAXED);
     return ROOT;
   }
+
+  TagNode **slot = &chunks[lb >> BDD_NODE_CHUNK_BITS];
+  TagNode *chunk = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+  if (chunk == NULL) {
+    TagNode *fresh = static_cast<TagNode *>(
+        ::operator new(BDD_NODE_CHUNK * sizeof(TagNode)));
+    chunk = NULL;
+    if (__atomic_compare_exchange_n(slot, &chunk, fresh, false,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      chunk = fresh;
+      uint32_t const nr = __atomic_add_fetch(&nr_chunks, 1, __ATOMIC_RELAXED);
+      uint32_t peak = __atomic_load_n(&peak_chunks, __ATOMIC_RELAXED);
+      while (peak < nr &&
+             !__atomic_compare_exchange_n(&peak_chunks, &peak, nr, true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+    } else
+      ::operator delete(fresh);
+  }
+  // the node is filled in before any link to it is stored
+  new (&chunk[lb & (BDD_NODE_CHUNK - 1)]) TagNode(parent, begin, end);
+  return lb;
 }
 
+// with @probe set, nothing is changed; ROOT is returned where a node
+// would have to be added or split
 lb_type BDDTag::insert_n_zeros(lb_type cur_lb, size_t num,
-                               lb_type last_one_lb) {
+                               lb_type last_one_lb, bool probe) {
 
   while (num != 0) {
-    lb_type next = nodes[cur_lb].left;
-    size_t next_size = nodes[next].get_seg_size();
+    lb_type next = LOAD(node(cur_lb).left);
+    size_t next_size = node(next).get_seg_size();
     if (next == 0) {
-      tag_off off = nodes[cur_lb].seg.end;
+      if (probe)
+        return ROOT;
+      tag_off off = LOAD(node(cur_lb).seg.end);
       lb_type new_lb = alloc_node(last_one_lb, off, off + num);
-      nodes[cur_lb].left = new_lb;
+      STORE(node(cur_lb).left, new_lb);
       cur_lb = new_lb;
       num = 0;
     } else if (next_size > num) {
-      tag_off off = nodes[cur_lb].seg.end;
+      if (probe)
+        return ROOT;
+      tag_off off = LOAD(node(cur_lb).seg.end);
       lb_type new_lb = alloc_node(last_one_lb, off, off + num);
-      nodes[cur_lb].left = new_lb;
+      STORE(node(cur_lb).left, new_lb);
       cur_lb = new_lb;
-      nodes[next].seg.begin = off + num;
+      STORE(node(next).seg.begin, off + num);
       num = 0;
     } else {
       cur_lb = next;
@@ -60,27 +134,32 @@ lb_type BDDTag::insert_n_zeros(lb_type cur_lb, size_t num,
   return cur_lb;
 }
 
-lb_type BDDTag::insert_n_ones(lb_type cur_lb, size_t num, lb_type last_one_lb) {
+lb_type BDDTag::insert_n_ones(lb_type cur_lb, size_t num, lb_type last_one_lb,
+                              bool probe) {
 
   while (num != 0) {
-    lb_type next = nodes[cur_lb].right;
-    tag_off last_end = nodes[cur_lb].seg.end;
+    lb_type next = LOAD(node(cur_lb).right);
+    tag_off last_end = LOAD(node(cur_lb).seg.end);
     if (next == 0) {
+      if (probe)
+        return ROOT;
       tag_off off = last_end;
       lb_type new_lb = alloc_node(last_one_lb, off, off + num);
-      nodes[cur_lb].right = new_lb;
+      STORE(node(cur_lb).right, new_lb);
       cur_lb = new_lb;
       num = 0;
     } else {
-      tag_off next_end = nodes[next].seg.end;
+      tag_off next_end = LOAD(node(next).seg.end);
       size_t next_size = next_end - last_end;
       if (next_size > num) {
+        if (probe)
+          return ROOT;
         tag_off off = last_end;
         lb_type new_lb = alloc_node(last_one_lb, off, off + num);
-        nodes[cur_lb].right = new_lb;
-        nodes[new_lb].right = next;
-        nodes[next].parent = new_lb;
-        nodes[next].seg.begin = off + num;
+        STORE(node(new_lb).right, next);
+        STORE(node(cur_lb).right, new_lb);
+        STORE(node(next).parent, new_lb);
+        STORE(node(next).seg.begin, off + num);
         cur_lb = new_lb;
         num = 0;
       } else {
@@ -92,17 +171,62 @@ lb_type BDDTag::insert_n_ones(lb_type cur_lb, size_t num, lb_type last_one_lb) {
   return cur_lb;
 }
 
+lb_type BDDTag::insert_walk(tag_off pos, bool probe) {
+  lb_type cur_lb = insert_n_zeros(ROOT, pos, ROOT, probe);
+  if (probe && cur_lb == ROOT && pos != 0)
+    return ROOT;
+  return insert_n_ones(cur_lb, 1, ROOT, probe);
+}
+
 lb_type BDDTag::insert(tag_off pos) {
-  lb_type cur_lb = insert_n_zeros(ROOT, pos, ROOT);
-  cur_lb = insert_n_ones(cur_lb, 1, ROOT);
+  // the label is usually there already
+  uint32_t v = read_begin();
+  lb_type cur_lb = insert_walk(pos, true);
+  if (cur_lb != ROOT && !read_retry(v))
+    return cur_lb;
+
+  write_begin();
+  cur_lb = insert_walk(pos, false);
+  write_end();
   return cur_lb;
 }
 
-void BDDTag::set_sign(lb_type lb) { nodes[lb].seg.sign = true; }
-bool BDDTag::get_sign(lb_type lb) { return nodes[lb].seg.sign; }
+// drop every cached result (writer lock held, or the tree not shared).
+// The fence pairs with the one in combine(): a result stored there
+// either is flushed here, or sees the version move and is taken back.
+static inline void combine_flush(uint64_t *cache) {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  for (size_t i = 0; i < (1 << BDD_COMBINE_CACHE_BITS); i++)
+    __atomic_store_n(&cache[i], 0, __ATOMIC_RELAXED);
+}
+
+// both change what existing labels stand for; cached results go stale.
+// Callers order them against combine() themselves.
+void BDDTag::set_sign(lb_type lb) {
+  write_begin();
+  STORE(node(lb).seg.sign, true);
+  combine_flush(combine_cache);
+  write_end();
+}
+bool BDDTag::get_sign(lb_type lb) { return LOAD(node(lb).seg.sign); }
 
 void BDDTag::set_size(lb_type lb, size_t size) {
-  nodes[lb].seg.end += (size - 1);
+  write_begin();
+  STORE(node(lb).seg.end, node(lb).seg.end + (tag_off)(size - 1));
+  combine_flush(combine_cache);
+  write_end();
+}
+
+// the index supplies the low bits of l2, so the entry only keeps l1,
+// the rest of l2 and the result
+static inline size_t combine_index(lb_type l1, lb_type l2) {
+  return (l2 ^ ((l1 * 0x9E3779B1U) >> (32 - BDD_COMBINE_CACHE_BITS))) &
+         ((1 << BDD_COMBINE_CACHE_BITS) - 1);
+}
+
+static inline uint64_t combine_key(lb_type l1, lb_type l2) {
+  return ((uint64_t)l1 << 40) |
+         ((uint64_t)(l2 >> BDD_COMBINE_CACHE_BITS) << BDD_LB_WIDTH);
 }
 
 lb_type BDDTag::combine(lb_type l1, lb_type l2) {
@@ -122,25 +246,76 @@ lb_type BDDTag::combine(lb_type l1, lb_type l2) {
     l1 = tmp;
   }
 
+  // labels keep their meaning as the tree grows, so a result stays valid
+  size_t idx = combine_index(l1, l2);
+  uint64_t key = combine_key(l1, l2);
+  uint64_t e = __atomic_load_n(&combine_cache[idx], __ATOMIC_ACQUIRE);
+  combine_counter &cnt = counters[idx & (BDD_NR_COUNTERS - 1)];
+  lb_type cur_lb;
+  if ((e & ~(uint64_t)LB_MASK) == key) {
+    COUNT(cnt.hits);
+    cur_lb = e & LB_MASK;
+  } else {
+    COUNT(cnt.misses);
+    // look the result up without the lock first
+    uint32_t v = read_begin();
+    cur_lb = combine_walk(l1, l2, true);
+    if (cur_lb != ROOT && !read_retry(v)) {
+      // a writer may flush the cache before the result is stored; it
+      // moved the version first, so check again and take it back
+      uint64_t e = key | cur_lb;
+      __atomic_store_n(&combine_cache[idx], e, __ATOMIC_RELEASE);
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);
+      if (__atomic_load_n(&version, __ATOMIC_RELAXED) != v)
+        __atomic_compare_exchange_n(&combine_cache[idx], &e, 0, false,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    } else {
+      write_begin();
+      cur_lb = combine_walk(l1, l2, false);
+      // flushes take the lock too, so this one cannot go stale
+      __atomic_store_n(&combine_cache[idx], key | cur_lb, __ATOMIC_RELEASE);
+      write_end();
+    }
+  }
+
+  if (has_len_lb) {
+    cur_lb |= LEN_LB;
+  }
+
+  return cur_lb;
+}
+
+void BDDTag::combine_stats(uint64_t *hits, uint64_t *misses) {
+  *hits = 0;
+  *misses = 0;
+  for (size_t i = 0; i < BDD_NR_COUNTERS; i++) {
+    *hits += __atomic_load_n(&counters[i].hits, __ATOMIC_RELAXED);
+    *misses += __atomic_load_n(&counters[i].misses, __ATOMIC_RELAXED);
+  }
+}
+
+// l1 <= l2, neither with the length flag
+lb_type BDDTag::combine_walk(lb_type l1, lb_type l2, bool probe) {
+
   // get all the segments
   std::stack<lb_type> lb_st;
   lb_type last_begin = MAX_LB;
 
   while (l1 > 0 && l1 != l2) {
-    tag_off b1 = nodes[l1].seg.begin;
-    tag_off b2 = nodes[l2].seg.begin;
+    tag_off b1 = LOAD(node(l1).seg.begin);
+    tag_off b2 = LOAD(node(l2).seg.begin);
     if (b1 < b2) {
       if (b2 < last_begin) {
         lb_st.push(l2);
         last_begin = b2;
       }
-      l2 = nodes[l2].parent;
+      l2 = LOAD(node(l2).parent);
     } else {
       if (b1 < last_begin) {
         lb_st.push(l1);
         last_begin = b1;
       }
-      l1 = nodes[l1].parent;
+      l1 = LOAD(node(l1).parent);
     }
   }
 
@@ -152,69 +327,228 @@ lb_type BDDTag::combine(lb_type l1, lb_type l2) {
   }
 
   while (!lb_st.empty()) {
-    tag_seg cur_seg = nodes[cur_lb].seg;
+    tag_off cur_end = LOAD(node(cur_lb).seg.end);
     lb_type next = lb_st.top();
     lb_st.pop();
-    tag_seg next_seg = nodes[next].seg;
+    tag_off next_begin = LOAD(node(next).seg.begin);
+    tag_off next_end = LOAD(node(next).seg.end);
 
-    if (cur_seg.end >= next_seg.begin) {
-      if (next_seg.end > cur_seg.end) {
-        size_t size = next_seg.end - cur_seg.end;
-        cur_lb = insert_n_ones(cur_lb, size, cur_lb);
+    if (cur_end >= next_begin) {
+      if (next_end > cur_end) {
+        size_t size = next_end - cur_end;
+        cur_lb = insert_n_ones(cur_lb, size, cur_lb, probe);
       }
     } else {
       lb_type last_lb = cur_lb;
-      size_t gap = next_seg.begin - cur_seg.end;
-      cur_lb = insert_n_zeros(cur_lb, gap, last_lb);
-      size_t size = next_seg.end - next_seg.begin;
-      cur_lb = insert_n_ones(cur_lb, size, last_lb);
+      size_t gap = next_begin - cur_end;
+      cur_lb = insert_n_zeros(cur_lb, gap, last_lb, probe);
+      if (probe && cur_lb == ROOT)
+        return ROOT;
+      size_t size = next_end - next_begin;
+      cur_lb = insert_n_ones(cur_lb, size, last_lb, probe);
     }
+    if (probe && cur_lb == ROOT)
+      return ROOT;
 
-    if (next_seg.sign) {
-      nodes[cur_lb].seg.sign = true;
+    if (LOAD(node(next).seg.sign) && !LOAD(node(cur_lb).seg.sign)) {
+      if (probe)
+        return ROOT;
+      STORE(node(cur_lb).seg.sign, true);
     }
   }
 
-  if (has_len_lb) {
-    cur_lb |= LEN_LB;
-  }
-
   return cur_lb;
 }
 
-const std::vector<tag_seg> BDDTag::find(lb_type lb) {
+bool BDDTag::low_on_labels() {
+  return __atomic_load_n(&nr_nodes, __ATOMIC_RELAXED) >= gc_low;
+}
 
-  lb = lb & LB_MASK;
-  std::vector<tag_seg> tag_list;
+// the label of @segs, sorted by their first offset, as combine_walk()
+// would put it together (writer lock held)
+lb_type BDDTag::build(std::vector<tag_seg> const &segs) {
+  lb_type cur_lb = ROOT;
+  for (size_t i = 0; i < segs.size(); i++) {
+    tag_off cur_end = node(cur_lb).seg.end;
+    if (cur_end >= segs[i].begin) {
+      if (segs[i].end > cur_end)
+        cur_lb = insert_n_ones(cur_lb, segs[i].end - cur_end, cur_lb, false);
+    } else {
+      lb_type last_lb = cur_lb;
+      cur_lb = insert_n_zeros(cur_lb, segs[i].begin - cur_end, last_lb, false);
+      cur_lb = insert_n_ones(cur_lb, segs[i].end - segs[i].begin, last_lb,
+                             false);
+    }
+    if (segs[i].sign)
+      STORE(node(cur_lb).seg.sign, true);
+  }
+  return cur_lb;
+}
+
+// the segments of @lb in the nodes of @dir, as find() reports them.
+// Adjacent ones must stay apart: combine_walk() keeps one of two nodes
+// that start at the same offset, which is only safe while both end at
+// the same place too, as in a tree that grew by combining.
+static void gc_segs(TagNode *const *dir, lb_type lb,
+                    std::vector<tag_seg> &segs) {
+  segs.clear();
   tag_off last_begin = MAX_LB;
   while (lb > 0) {
-    if (nodes[lb].seg.begin < last_begin) {
-      tag_list.push_back(nodes[lb].seg);
-      last_begin = nodes[lb].seg.begin;
+    TagNode const &n = dir[lb >> BDD_NODE_CHUNK_BITS][lb & (BDD_NODE_CHUNK - 1)];
+    if (n.seg.begin < last_begin) {
+      segs.push_back(n.seg);
+      last_begin = n.seg.begin;
     }
-    lb = nodes[lb].parent;
+    lb = n.parent;
   }
+  std::reverse(segs.begin(), segs.end());
+}
+
+// mark the labels in use; any non-zero entry of the map will do
+static lb_type gc_mark(lb_type lb, void *arg) {
+  std::vector<lb_type> &map = *static_cast<std::vector<lb_type> *>(arg);
+  lb_type const l = lb & LB_MASK;
+  if (l < map.size())
+    map[l] = 1;
+  return lb;
+}
 
-  if (tag_list.size() > 1) {
-    std::reverse(tag_list.begin(), tag_list.end());
+// the new label of @lb, with its length flag kept
+static lb_type gc_remap(lb_type lb, void *arg) {
+  std::vector<lb_type> &map = *static_cast<std::vector<lb_type> *>(arg);
+  lb_type const l = lb & LB_MASK;
+  if (l == ROOT || l >= map.size())
+    return lb;
+  return (lb & ~(lb_type)LB_MASK) | map[l];
+}
+
+// rebuild the tree from the labels that @roots reports in use, and
+// give them their new values; dead labels and the nodes that only
+// they needed are dropped, and labels for the same set become one.
+// No other thread may use the tree meanwhile (e.g., the application
+// threads are stopped).
+//
+// returns: the number of nodes reclaimed
+size_t BDDTag::collect(bdd_roots_fn roots) {
+  write_begin();
+  lb_type const old_nr = std::min(nr_nodes, (lb_type)MAX_LB);
+  std::vector<lb_type> map(old_nr, 0);
+  roots(gc_mark, &map);
+
+  TagNode *old_chunks[BDD_NR_CHUNKS];
+  memcpy(old_chunks, chunks, sizeof(chunks));
+  memset(chunks, 0, sizeof(chunks));
+  uint32_t const old_nr_chunks = nr_chunks;
+  nr_nodes = 0;
+  alloc_node(ROOT, 0, 0);
+
+  std::vector<tag_seg> segs;
+  for (lb_type lb = 1; lb < old_nr; lb++) {
+    if (map[lb] == 0)
+      continue;
+    gc_segs(old_chunks, lb, segs);
+    map[lb] = build(segs);
   }
+  roots(gc_remap, &map);
 
-  return tag_list;
-};
+  for (size_t i = 0; i < BDD_NR_CHUNKS; i++)
+    ::operator delete(old_chunks[i]);
+  // both trees were there for a while, and count towards the peak
+  nr_chunks -= old_nr_chunks;
+  combine_flush(combine_cache);
 
-std::string BDDTag::to_string(lb_type lb) {
+  size_t const reclaimed = old_nr - nr_nodes;
+  gc_runs++;
+  gc_reclaimed += reclaimed;
+  // do not come back before half of what is left has been used
+  gc_low = std::max((lb_type)BDD_GC_LOW, nr_nodes + (MAX_LB - nr_nodes) / 2);
+  write_end();
+  return reclaimed;
+}
+
+void BDDTag::gc_stats(uint64_t *runs, uint64_t *reclaimed, uint64_t *live) {
+  *runs = gc_runs;
+  *reclaimed = gc_reclaimed;
+  *live = std::min(__atomic_load_n(&nr_nodes, __ATOMIC_RELAXED),
+                   (lb_type)MAX_LB);
+}
+
+// bytes held by the node chunks now and at most, and by the cache
+void BDDTag::mem_stats(uint64_t *nodes, uint64_t *peak_nodes,
+                       uint64_t *cache) {
+  uint64_t const per_chunk = BDD_NODE_CHUNK * sizeof(TagNode);
+  *nodes = __atomic_load_n(&nr_chunks, __ATOMIC_RELAXED) * per_chunk;
+  *peak_nodes = __atomic_load_n(&peak_chunks, __ATOMIC_RELAXED) * per_chunk;
+  *cache = sizeof(combine_cache);
+}
+
+// a label with more segments than a batch holds takes one walk per
+// batch; each starts where the last one ended, and nodes split in
+// between are clipped to it
+void BDDTag::visit(lb_type lb, bdd_seg_fn fn, void *arg) {
 
   lb = lb & LB_MASK;
-  std::string ss = "";
-  ss += "{";
-  std::vector<tag_seg> tags = find(lb);
-  char buf[100];
-  for (std::vector<tag_seg>::iterator it = tags.begin(); it != tags.end();
-       ++it) {
-    sprintf(buf, "(%d, %d) ", it->begin, it->end);
-    std::string s(buf);
-    ss += s;
+  tag_seg batch[BDD_VISIT_BATCH];
+  tag_off done = 0;
+  for (;;) {
+    // the segments get lower towards the root; the ring keeps the
+    // lowest ones that end past @done
+    size_t nr;
+    uint32_t v;
+    do {
+      v = read_begin();
+      nr = 0;
+      lb_type cur_lb = lb;
+      tag_off last_begin = MAX_LB;
+      while (cur_lb > 0) {
+        TagNode &n = node(cur_lb);
+        tag_off begin = LOAD(n.seg.begin);
+        if (begin < last_begin) {
+          tag_off end = LOAD(n.seg.end);
+          if (end <= done)
+            break;
+          tag_seg &seg = batch[nr++ % BDD_VISIT_BATCH];
+          seg.sign = LOAD(n.seg.sign);
+          seg.begin = std::max(begin, done);
+          seg.end = end;
+          last_begin = begin;
+        }
+        cur_lb = LOAD(n.parent);
+      }
+    } while (read_retry(v));
+
+    size_t const kept = std::min(nr, (size_t)BDD_VISIT_BATCH);
+    for (size_t i = 1; i <= kept; i++) {
+      if (!fn(&batch[(nr - i) % BDD_VISIT_BATCH], arg))
+        return;
+    }
+    if (nr == kept)
+      return;
+    done = batch[(nr - kept) % BDD_VISIT_BATCH].end;
   }
+}
+
+static bool find_seg(tag_seg const *seg, void *arg) {
+  static_cast<std::vector<tag_seg> *>(arg)->push_back(*seg);
+  return true;
+}
+
+const std::vector<tag_seg> BDDTag::find(lb_type lb) {
+  std::vector<tag_seg> tag_list;
+  visit(lb, find_seg, &tag_list);
+  return tag_list;
+};
+
+static bool sprint_seg(tag_seg const *seg, void *arg) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "(%u, %u) ", seg->begin, seg->end);
+  *static_cast<std::string *>(arg) += buf;
+  return true;
+}
+
+std::string BDDTag::to_string(lb_type lb) {
+  std::string ss = "{";
+  visit(lb, sprint_seg, &ss);
   ss += "}";
   return ss;
 }
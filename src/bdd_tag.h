@@ -1,9 +1,11 @@
 //! Implements a data structure for sets.
-// TODO: Mutex, support mutiple thread
+// Safe to share between threads: lookups take no lock, and only calls
+// that have to add nodes serialize on the writer lock.
 
 #ifndef BDD_TAG_H
 #define BDD_TAG_H
 
+#include "pin.H"
 #include <algorithm>
 #include <stdint.h>
 #include <string>
@@ -28,6 +30,51 @@ struct tag_seg {
 
 #endif
 
+/*
+ * combine() results are memoized in a direct-mapped cache of
+ * 2^BDD_COMBINE_CACHE_BITS entries, indexed by a hash of the pair; an
+ * entry packs the pair and the result into one word, so it is read and
+ * written without a lock
+ */
+#ifndef BDD_COMBINE_CACHE_BITS
+#define BDD_COMBINE_CACHE_BITS 14
+#endif
+#if BDD_COMBINE_CACHE_BITS < 8 || BDD_COMBINE_CACHE_BITS > BDD_LB_WIDTH
+#error "BDD_COMBINE_CACHE_BITS must be between 8 and BDD_LB_WIDTH"
+#endif
+
+// nodes are kept in chunks of 2^BDD_NODE_CHUNK_BITS that never move
+#define BDD_NODE_CHUNK_BITS 16
+#define BDD_NODE_CHUNK (1 << BDD_NODE_CHUNK_BITS)
+#define BDD_NR_CHUNKS (1 << (BDD_LB_WIDTH - BDD_NODE_CHUNK_BITS))
+
+// a collection is wanted once this many labels are in use
+#ifndef BDD_GC_LOW
+#define BDD_GC_LOW (((1 << BDD_LB_WIDTH) >> 3) * 7)
+#endif
+
+// collect() calls a roots function that passes every label in use to
+// the map function, and stores back what it returns
+typedef lb_type (*bdd_map_fn)(lb_type lb, void *arg);
+typedef void (*bdd_roots_fn)(bdd_map_fn fn, void *arg);
+
+// visit() hands the segments of a label to the callback by ascending
+// offset; it returns false to stop. They are gathered on the stack,
+// BDD_VISIT_BATCH per walk up the tree.
+typedef bool (*bdd_seg_fn)(tag_seg const *seg, void *arg);
+#ifndef BDD_VISIT_BATCH
+#define BDD_VISIT_BATCH 32
+#endif
+
+// the hit counters are spread over cache lines, so that threads do not
+// fight over one
+#define BDD_NR_COUNTERS 16
+
+struct combine_counter {
+  uint64_t hits;
+  uint64_t misses;
+} __attribute__((aligned(64)));
+
 class TagNode {
 public:
   lb_type left;
@@ -42,16 +89,46 @@ public:
     seg.begin = begin;
     seg.end = end;
   };
-  unsigned int get_seg_size() { return (seg.end - seg.begin); }
+  unsigned int get_seg_size() {
+    return __atomic_load_n(&seg.end, __ATOMIC_ACQUIRE) -
+           __atomic_load_n(&seg.begin, __ATOMIC_ACQUIRE);
+  }
 };
 
 class BDDTag {
 private:
-  std::vector<TagNode> nodes;
+  // a label is an index into the chunks; they are allocated on demand
+  TagNode *chunks[BDD_NR_CHUNKS];
+  lb_type nr_nodes;
+  // chunks installed now, and the most there ever were
+  uint32_t nr_chunks;
+  uint32_t peak_chunks;
+  // serializes changes to the tree
+  PIN_MUTEX write_lock;
+  // odd while the tree is being changed; readers that saw it move retry
+  uint32_t version;
+  uint64_t combine_cache[1 << BDD_COMBINE_CACHE_BITS];
+  combine_counter counters[BDD_NR_COUNTERS];
+  // labels in use that make collection worthwhile
+  lb_type gc_low;
+  uint64_t gc_runs;
+  uint64_t gc_reclaimed;
+  TagNode &node(lb_type lb) {
+    return chunks[lb >> BDD_NODE_CHUNK_BITS][lb & (BDD_NODE_CHUNK - 1)];
+  }
   void dfs_clear(TagNode *cur_node);
+  void write_begin();
+  void write_end();
+  uint32_t read_begin();
+  bool read_retry(uint32_t v);
   lb_type alloc_node(lb_type parent, tag_off begin, tag_off end);
-  lb_type insert_n_zeros(lb_type cur_lb, size_t num, lb_type last_one_lb);
-  lb_type insert_n_ones(lb_type cur_lb, size_t num, lb_type last_one_lb);
+  lb_type insert_n_zeros(lb_type cur_lb, size_t num, lb_type last_one_lb,
+                         bool probe);
+  lb_type insert_n_ones(lb_type cur_lb, size_t num, lb_type last_one_lb,
+                        bool probe);
+  lb_type insert_walk(tag_off pos, bool probe);
+  lb_type combine_walk(lb_type l1, lb_type l2, bool probe);
+  lb_type build(std::vector<tag_seg> const &segs);
 
 public:
   BDDTag();
@@ -61,7 +138,13 @@ public:
   bool get_sign(lb_type lb);
   void set_size(lb_type lb, size_t size);
   lb_type combine(lb_type lb1, lb_type lb2);
+  void combine_stats(uint64_t *hits, uint64_t *misses);
+  bool low_on_labels();
+  size_t collect(bdd_roots_fn roots);
+  void gc_stats(uint64_t *runs, uint64_t *reclaimed, uint64_t *live);
+  void mem_stats(uint64_t *nodes, uint64_t *peak_nodes, uint64_t *cache);
 
+  void visit(lb_type lb, bdd_seg_fn fn, void *arg);
   const std::vector<tag_seg> find(lb_type lb);
   std::string to_string(lb_type lb);
 };
@@ -96,36 +96,46 @@ static void PIN_FAST_ANALYSIS_CALL m2r_binary_opb_l(THREADID tid, uint32_t dst,
 static void PIN_FAST_ANALYSIS_CALL m2r_binary_opw(THREADID tid, uint32_t dst,
                                                   ADDRINT src) {
   tag_t *dst_tags = RTAG[dst];
+  tag_t buf[2];
+  tag_t const *src_tags = MSPAN(src, 2, buf);
   for (size_t i = 0; i < 2; i++)
-    dst_tags[i] = tag_combine(dst_tags[i], MTAG(src + i));
+    dst_tags[i] = tag_combine(dst_tags[i], src_tags[i]);
 }
 
 static void PIN_FAST_ANALYSIS_CALL m2r_binary_opl(THREADID tid, uint32_t dst,
                                                   ADDRINT src) {
   tag_t *dst_tags = RTAG[dst];
+  tag_t buf[4];
+  tag_t const *src_tags = MSPAN(src, 4, buf);
   for (size_t i = 0; i < 4; i++)
-    dst_tags[i] = tag_combine(dst_tags[i], MTAG(src + i));
+    dst_tags[i] = tag_combine(dst_tags[i], src_tags[i]);
 }
 
 static void PIN_FAST_ANALYSIS_CALL m2r_binary_opq(THREADID tid, uint32_t dst,
                                                   ADDRINT src) {
   tag_t *dst_tags = RTAG[dst];
+  tag_t buf[8];
+  tag_t const *src_tags = MSPAN(src, 8, buf);
   for (size_t i = 0; i < 8; i++)
-    dst_tags[i] = tag_combine(dst_tags[i], MTAG(src + i));
+    dst_tags[i] = tag_combine(dst_tags[i], src_tags[i]);
 }
 
 static void PIN_FAST_ANALYSIS_CALL m2r_binary_opx(THREADID tid, uint32_t dst,
                                                   ADDRINT src) {
   tag_t *dst_tags = RTAG[dst];
+  tag_t buf[16];
+  tag_t const *src_tags = MSPAN(src, 16, buf);
   for (size_t i = 0; i < 16; i++)
-    dst_tags[i] = tag_combine(dst_tags[i], MTAG(src + i));
+    dst_tags[i] = tag_combine(dst_tags[i], src_tags[i]);
 }
 
 static void PIN_FAST_ANALYSIS_CALL m2r_binary_opy(THREADID tid, uint32_t dst,
                                                   ADDRINT src) {
   tag_t *dst_tags = RTAG[dst];
+  tag_t buf[32];
+  tag_t const *src_tags = MSPAN(src, 32, buf);
   for (size_t i = 0; i < 32; i++)
-    dst_tags[i] = tag_combine(dst_tags[i], MTAG(src + i));
+    dst_tags[i] = tag_combine(dst_tags[i], src_tags[i]);
 }
 
 static void PIN_FAST_ANALYSIS_CALL r2m_binary_opb_u(THREADID tid, ADDRINT dst,
@@ -149,36 +159,51 @@ static void PIN_FAST_ANALYSIS_CALL r2m_binary_opb_l(THREADID tid, ADDRINT dst,
 static void PIN_FAST_ANALYSIS_CALL r2m_binary_opw(THREADID tid, ADDRINT dst,
                                                   uint32_t src) {
   tag_t *src_tags = RTAG[src];
+  tag_t dst_tags[2];
+  MTAGN(dst, 2, dst_tags);
   for (size_t i = 0; i < 2; i++)
-    tagmap_setb(dst + i, tag_combine(MTAG(dst + i), src_tags[i]));
+    dst_tags[i] = tag_combine(dst_tags[i], src_tags[i]);
+  tagmap_setn_tags(dst, 2, dst_tags);
 }
 
 static void PIN_FAST_ANALYSIS_CALL r2m_binary_opl(THREADID tid, ADDRINT dst,
                                                   uint32_t src) {
   tag_t *src_tags = RTAG[src];
+  tag_t dst_tags[4];
+  MTAGN(dst, 4, dst_tags);
   for (size_t i = 0; i < 4; i++)
-    tagmap_setb(dst + i, tag_combine(MTAG(dst + i), src_tags[i]));
+    dst_tags[i] = tag_combine(dst_tags[i], src_tags[i]);
+  tagmap_setn_tags(dst, 4, dst_tags);
 }
 
 static void PIN_FAST_ANALYSIS_CALL r2m_binary_opq(THREADID tid, ADDRINT dst,
                                                   uint32_t src) {
   tag_t *src_tags = RTAG[src];
+  tag_t dst_tags[8];
+  MTAGN(dst, 8, dst_tags);
   for (size_t i = 0; i < 8; i++)
-    tagmap_setb(dst + i, tag_combine(MTAG(dst + i), src_tags[i]));
+    dst_tags[i] = tag_combine(dst_tags[i], src_tags[i]);
+  tagmap_setn_tags(dst, 8, dst_tags);
 }
 
 static void PIN_FAST_ANALYSIS_CALL r2m_binary_opx(THREADID tid, ADDRINT dst,
                                                   uint32_t src) {
   tag_t *src_tags = RTAG[src];
+  tag_t dst_tags[16];
+  MTAGN(dst, 16, dst_tags);
   for (size_t i = 0; i < 16; i++)
-    tagmap_setb(dst + i, tag_combine(MTAG(dst + i), src_tags[i]));
+    dst_tags[i] = tag_combine(dst_tags[i], src_tags[i]);
+  tagmap_setn_tags(dst, 16, dst_tags);
 }
 
 static void PIN_FAST_ANALYSIS_CALL r2m_binary_opy(THREADID tid, ADDRINT dst,
                                                   uint32_t src) {
   tag_t *src_tags = RTAG[src];
+  tag_t dst_tags[32];
+  MTAGN(dst, 32, dst_tags);
   for (size_t i = 0; i < 32; i++)
-    tagmap_setb(dst + i, tag_combine(MTAG(dst + i), src_tags[i]));
+    dst_tags[i] = tag_combine(dst_tags[i], src_tags[i]);
+  tagmap_setn_tags(dst, 32, dst_tags);
 }
 
 void ins_binary_op(INS ins) {
@@ -54,37 +54,28 @@
         RTAG[(RIDX)][30], RTAG[(RIDX)][31]                                     \
   }
 
-#define MTAG(ADDR) tagmap_getb((ADDR))
+/*
+ * memory tags are looked up through the page cache of the thread;
+ * with coarse tags (LIBDFT_TAG_GRAN_BITS) every byte of a granule
+ * reads the granule's tag
+ */
+#define MTAG(ADDR) tagmap_getb_cached(&threads_ctx[tid].page_cache, (ADDR))
 #define M8TAG(ADDR)                                                            \
-  { tagmap_getb((ADDR)) }
-#define M16TAG(ADDR)                                                           \
-  { MTAG(ADDR), MTAG(ADDR + 1) }
-#define M32TAG(ADDR)                                                           \
-  { MTAG(ADDR), MTAG(ADDR + 1), MTAG(ADDR + 2), MTAG(ADDR + 3) }
-#define M64TAG(ADDR)                                                           \
-  {                                                                            \
-    MTAG(ADDR), MTAG(ADDR + 1), MTAG(ADDR + 2), MTAG(ADDR + 3),                \
-        MTAG(ADDR + 4), MTAG(ADDR + 5), MTAG(ADDR + 6), MTAG(ADDR + 7)         \
-  }
-#define M128TAG(ADDR)                                                          \
-  {                                                                            \
-    MTAG(ADDR), MTAG(ADDR + 1), MTAG(ADDR + 2), MTAG(ADDR + 3),                \
-        MTAG(ADDR + 4), MTAG(ADDR + 5), MTAG(ADDR + 6), MTAG(ADDR + 7),        \
-        MTAG(ADDR + 8), MTAG(ADDR + 9), MTAG(ADDR + 10), MTAG(ADDR + 11),      \
-        MTAG(ADDR + 12), MTAG(ADDR + 13), MTAG(ADDR + 14), MTAG(ADDR + 15)     \
-  }
-
-#define M256TAG(ADDR)                                                          \
-  {                                                                            \
-    MTAG(ADDR), MTAG(ADDR + 1), MTAG(ADDR + 2), MTAG(ADDR + 3),                \
-        MTAG(ADDR + 4), MTAG(ADDR + 5), MTAG(ADDR + 6), MTAG(ADDR + 7),        \
-        MTAG(ADDR + 8), MTAG(ADDR + 9), MTAG(ADDR + 10), MTAG(ADDR + 11),      \
-        MTAG(ADDR + 12), MTAG(ADDR + 13), MTAG(ADDR + 14), MTAG(ADDR + 15),    \
-        MTAG(ADDR + 16), MTAG(ADDR + 17), MTAG(ADDR + 18), MTAG(ADDR + 19),    \
-        MTAG(ADDR + 20), MTAG(ADDR + 21), MTAG(ADDR + 22), MTAG(ADDR + 23),    \
-        MTAG(ADDR + 24), MTAG(ADDR + 25), MTAG(ADDR + 26), MTAG(ADDR + 27),    \
-        MTAG(ADDR + 28), MTAG(ADDR + 29), MTAG(ADDR + 30), MTAG(ADDR + 31),    \
-  }
+  { MTAG(ADDR) }
+/*
+ * multi-byte accesses resolve their tag page once: MTAGN copies the
+ * tags of the N bytes at ADDR into TAGS, and MSPAN returns them in
+ * place, using BUF (N tags) only for an access that crosses a page
+ */
+#define MTAGN(ADDR, N, TAGS)                                                   \
+  tagmap_getn_tags_cached(&threads_ctx[tid].page_cache, (ADDR), (N), (TAGS))
+#define MSPAN(ADDR, N, BUF)                                                    \
+  tagmap_getn_span(&threads_ctx[tid].page_cache, (ADDR), (N), (BUF))
+#define M16TAG(ADDR, TAGS) MTAGN((ADDR), 2, (TAGS))
+#define M32TAG(ADDR, TAGS) MTAGN((ADDR), 4, (TAGS))
+#define M64TAG(ADDR, TAGS) MTAGN((ADDR), 8, (TAGS))
+#define M128TAG(ADDR, TAGS) MTAGN((ADDR), 16, (TAGS))
+#define M256TAG(ADDR, TAGS) MTAGN((ADDR), 32, (TAGS))
 
 // https://software.intel.com/sites/landingpage/pintool/docs/97619/Pin/html/group__REG__CPU__IA32.html
 inline size_t REG_INDX(REG reg) {
@@ -348,8 +339,8 @@ inline size_t REG_INDX(REG reg) {
 
 #define M2M_CALL(fn)                                                           \
   INS_InsertPredicatedCall(ins, IPOINT_BEFORE, (AFUNPTR)fn,                    \
-                           IARG_FAST_ANALYSIS_CALL, IARG_MEMORYWRITE_EA,       \
-                           IARG_MEMORYREAD_EA, IARG_END);
+                           IARG_FAST_ANALYSIS_CALL, IARG_THREAD_ID,            \
+                           IARG_MEMORYWRITE_EA, IARG_MEMORYREAD_EA, IARG_END);
 
 #define M_CLEAR_N(n)                                                           \
   INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR)tagmap_clrn,                     \
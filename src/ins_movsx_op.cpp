@@ -152,7 +152,8 @@ static void PIN_FAST_ANALYSIS_CALL _movsx_m2r_opqb(THREADID tid, uint32_t dst,
 static void PIN_FAST_ANALYSIS_CALL _movsx_m2r_oplw(THREADID tid, uint32_t dst,
                                                    ADDRINT src) {
   /* temporary tag value */
-  tag_t src_tags[] = M16TAG(src);
+  tag_t src_tags[2];
+  M16TAG(src, src_tags);
   tag_t *rtag_dst = RTAG[dst];
 
   /* update the destination (xfer) */
@@ -163,7 +164,8 @@ static void PIN_FAST_ANALYSIS_CALL _movsx_m2r_oplw(THREADID tid, uint32_t dst,
 static void PIN_FAST_ANALYSIS_CALL _movsx_m2r_opqw(THREADID tid, uint32_t dst,
                                                    ADDRINT src) {
   /* temporary tag value */
-  tag_t src_tags[] = M16TAG(src);
+  tag_t src_tags[2];
+  M16TAG(src, src_tags);
   tag_t *rtag_dst = RTAG[dst];
 
   /* update the destination (xfer) */
@@ -174,7 +176,8 @@ static void PIN_FAST_ANALYSIS_CALL _movsx_m2r_opqw(THREADID tid, uint32_t dst,
 static void PIN_FAST_ANALYSIS_CALL _movsx_m2r_opql(THREADID tid, uint32_t dst,
                                                    ADDRINT src) {
   /* temporary tag value */
-  tag_t src_tags[] = M32TAG(src);
+  tag_t src_tags[4];
+  M32TAG(src, src_tags);
 
   tag_t *rtag_dst = RTAG[dst];
 
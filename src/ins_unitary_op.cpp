@@ -63,7 +63,8 @@ static void PIN_FAST_ANALYSIS_CALL m2r_unitary_opb(THREADID tid, ADDRINT src) {
 }
 
 static void PIN_FAST_ANALYSIS_CALL m2r_unitary_opw(THREADID tid, ADDRINT src) {
-  tag_t tmp_tag[] = M16TAG(src);
+  tag_t tmp_tag[2];
+  M16TAG(src, tmp_tag);
   tag_t dst1_tag[] = R16TAG(DFT_REG_RDX);
   tag_t dst2_tag[] = R16TAG(DFT_REG_RAX);
 
@@ -74,7 +75,8 @@ static void PIN_FAST_ANALYSIS_CALL m2r_unitary_opw(THREADID tid, ADDRINT src) {
 }
 
 static void PIN_FAST_ANALYSIS_CALL m2r_unitary_opq(THREADID tid, ADDRINT src) {
-  tag_t tmp_tag[] = M64TAG(src);
+  tag_t tmp_tag[8];
+  M64TAG(src, tmp_tag);
   tag_t dst1_tag[] = R64TAG(DFT_REG_RDX);
   tag_t dst2_tag[] = R64TAG(DFT_REG_RAX);
 
@@ -85,7 +87,8 @@ static void PIN_FAST_ANALYSIS_CALL m2r_unitary_opq(THREADID tid, ADDRINT src) {
 }
 
 static void PIN_FAST_ANALYSIS_CALL m2r_unitary_opl(THREADID tid, ADDRINT src) {
-  tag_t tmp_tag[] = M32TAG(src);
+  tag_t tmp_tag[4];
+  M32TAG(src, tmp_tag);
   tag_t dst1_tag[] = R32TAG(DFT_REG_RDX);
   tag_t dst2_tag[] = R32TAG(DFT_REG_RAX);
 
@@ -123,13 +123,7 @@ static ADDRINT PIN_FAST_ANALYSIS_CALL _cmpxchg_m2r_opq_fast(THREADID tid,
   for (size_t i = 0; i < 8; i++)
     RTAG[DFT_REG_HELPER1][i] = save_tags[i];
 
-  tag_t src_tags[] = {tagmap_getb(src),     tagmap_getb(src + 1),
-                      tagmap_getb(src + 2), tagmap_getb(src + 3),
-                      tagmap_getb(src + 4), tagmap_getb(src + 5),
-                      tagmap_getb(src + 6), tagmap_getb(src + 7)};
-  for (size_t i = 0; i < 8; i++) {
-    RTAG[DFT_REG_RAX][i] = src_tags[i];
-  }
+  M64TAG(src, RTAG[DFT_REG_RAX]);
 
   return (dst_val == *(uint32_t *)src);
 }
@@ -144,11 +138,7 @@ static ADDRINT PIN_FAST_ANALYSIS_CALL _cmpxchg_m2r_opl_fast(THREADID tid,
   for (size_t i = 0; i < 4; i++)
     RTAG[DFT_REG_HELPER1][i] = save_tags[i];
 
-  tag_t src_tags[] = {tagmap_getb(src), tagmap_getb(src + 1),
-                      tagmap_getb(src + 2), tagmap_getb(src + 3)};
-  for (size_t i = 0; i < 4; i++) {
-    RTAG[DFT_REG_RAX][i] = src_tags[i];
-  }
+  M32TAG(src, RTAG[DFT_REG_RAX]);
 
   return (dst_val == *(uint32_t *)src);
 }
@@ -161,10 +151,7 @@ static void PIN_FAST_ANALYSIS_CALL _cmpxchg_r2m_opq_slow(THREADID tid,
     RTAG[DFT_REG_RAX][i] = saved_tags[i];
 
   /* update */
-  tag_t src_tags[] = R64TAG(src);
-  for (size_t i = 0; i < 8; i++) {
-    tagmap_setb(dst + i, src_tags[i]);
-  }
+  tagmap_setn_tags(dst, 8, RTAG[src]);
 }
 
 static void PIN_FAST_ANALYSIS_CALL _cmpxchg_r2m_opl_slow(THREADID tid,
@@ -175,10 +162,7 @@ static void PIN_FAST_ANALYSIS_CALL _cmpxchg_r2m_opl_slow(THREADID tid,
     RTAG[DFT_REG_RAX][i] = saved_tags[i];
 
   /* update */
-  tag_t src_tags[] = R32TAG(src);
-  for (size_t i = 0; i < 4; i++) {
-    tagmap_setb(dst + i, src_tags[i]);
-  }
+  tagmap_setn_tags(dst, 4, RTAG[src]);
 }
 
 static ADDRINT PIN_FAST_ANALYSIS_CALL _cmpxchg_m2r_opw_fast(THREADID tid,
@@ -192,10 +176,7 @@ static ADDRINT PIN_FAST_ANALYSIS_CALL _cmpxchg_m2r_opw_fast(THREADID tid,
   for (size_t i = 0; i < 4; i++)
     RTAG[DFT_REG_HELPER1][i] = save_tags[i];
 
-  tag_t src_tags[] = {tagmap_getb(src), tagmap_getb(src + 1)};
-  for (size_t i = 0; i < 2; i++) {
-    RTAG[DFT_REG_RAX][i] = src_tags[i];
-  }
+  M16TAG(src, RTAG[DFT_REG_RAX]);
 
   /* compare the dst and src values; the original values the tag bits */
   return (dst_val == *(uint16_t *)src);
@@ -212,10 +193,7 @@ static void PIN_FAST_ANALYSIS_CALL _cmpxchg_r2m_opw_slow(THREADID tid,
     RTAG[DFT_REG_RAX][i] = saved_tags[i];
 
   /* update */
-  tag_t src_tags[] = {RTAG[src][0], RTAG[src][1]};
-  for (size_t i = 0; i < 2; i++) {
-    tagmap_setb(dst + i, src_tags[i]);
-  }
+  tagmap_setn_tags(dst, 2, RTAG[src]);
 }
 
 static void PIN_FAST_ANALYSIS_CALL _xchg_r2r_opb_ul(THREADID tid, uint32_t dst,
@@ -306,57 +284,29 @@ static void PIN_FAST_ANALYSIS_CALL _xchg_m2r_opw(THREADID tid, uint32_t dst,
   /* temporary tag value */
   tag_t tmp_tag[] = R16TAG(dst);
 
-  tag_t src_tag[] = M16TAG(src);
-
   /* swap */
-  RTAG[dst][0] = src_tag[0];
-  RTAG[dst][1] = src_tag[1];
-  tagmap_setb(src, tmp_tag[0]);
-  tagmap_setb(src + 1, tmp_tag[1]);
+  M16TAG(src, RTAG[dst]);
+  tagmap_setn_tags(src, 2, tmp_tag);
 }
 
 static void PIN_FAST_ANALYSIS_CALL _xchg_m2r_opq(THREADID tid, uint32_t dst,
                                                  ADDRINT src) {
   /* temporary tag value */
   tag_t tmp_tag[] = R64TAG(dst);
-  tag_t src_tag[] = M64TAG(src);
 
   /* swap */
-  RTAG[dst][0] = src_tag[0];
-  RTAG[dst][1] = src_tag[1];
-  RTAG[dst][2] = src_tag[2];
-  RTAG[dst][3] = src_tag[3];
-  RTAG[dst][4] = src_tag[4];
-  RTAG[dst][5] = src_tag[5];
-  RTAG[dst][6] = src_tag[6];
-  RTAG[dst][7] = src_tag[7];
-
-  tagmap_setb(src, tmp_tag[0]);
-  tagmap_setb(src + 1, tmp_tag[1]);
-  tagmap_setb(src + 2, tmp_tag[2]);
-  tagmap_setb(src + 3, tmp_tag[3]);
-  tagmap_setb(src + 4, tmp_tag[4]);
-  tagmap_setb(src + 5, tmp_tag[5]);
-  tagmap_setb(src + 6, tmp_tag[6]);
-  tagmap_setb(src + 7, tmp_tag[7]);
+  M64TAG(src, RTAG[dst]);
+  tagmap_setn_tags(src, 8, tmp_tag);
 }
 
 static void PIN_FAST_ANALYSIS_CALL _xchg_m2r_opl(THREADID tid, uint32_t dst,
                                                  ADDRINT src) {
   /* temporary tag value */
   tag_t tmp_tag[] = R32TAG(dst);
-  tag_t src_tag[] = M32TAG(src);
 
   /* swap */
-  RTAG[dst][0] = src_tag[0];
-  RTAG[dst][1] = src_tag[1];
-  RTAG[dst][2] = src_tag[2];
-  RTAG[dst][3] = src_tag[3];
-
-  tagmap_setb(src, tmp_tag[0]);
-  tagmap_setb(src + 1, tmp_tag[1]);
-  tagmap_setb(src + 2, tmp_tag[2]);
-  tagmap_setb(src + 3, tmp_tag[3]);
+  M32TAG(src, RTAG[dst]);
+  tagmap_setn_tags(src, 4, tmp_tag);
 }
 
 static void PIN_FAST_ANALYSIS_CALL _xadd_r2r_opb_ul(THREADID tid, uint32_t dst,
@@ -444,35 +394,40 @@ static void PIN_FAST_ANALYSIS_CALL _xadd_r2m_opb_l(THREADID tid, ADDRINT dst,
 static void PIN_FAST_ANALYSIS_CALL _xadd_r2m_opw(THREADID tid, ADDRINT dst,
                                                  uint32_t src) {
   tag_t src_tag[] = R16TAG(src);
-  tag_t dst_tag[] = M16TAG(dst);
-
-  RTAG[src][0] = dst_tag[0];
-  RTAG[src][1] = dst_tag[1];
+  tag_t dst_tag[2];
+  M16TAG(dst, dst_tag);
 
-  tagmap_setb(dst, tag_combine(dst_tag[0], src_tag[0]));
-  tagmap_setb(dst + 1, tag_combine(dst_tag[1], src_tag[1]));
+  for (size_t i = 0; i < 2; i++) {
+    src_tag[i] = tag_combine(dst_tag[i], src_tag[i]);
+    RTAG[src][i] = dst_tag[i];
+  }
+  tagmap_setn_tags(dst, 2, src_tag);
 }
 
 static void PIN_FAST_ANALYSIS_CALL _xadd_r2m_opl(THREADID tid, ADDRINT dst,
                                                  uint32_t src) {
   tag_t src_tag[] = R32TAG(src);
-  tag_t dst_tag[] = M32TAG(dst);
+  tag_t dst_tag[4];
+  M32TAG(dst, dst_tag);
 
   for (size_t i = 0; i < 4; i++) {
-    tagmap_setb(dst + i, tag_combine(dst_tag[i], src_tag[i]));
+    src_tag[i] = tag_combine(dst_tag[i], src_tag[i]);
     RTAG[src][i] = dst_tag[i];
   }
+  tagmap_setn_tags(dst, 4, src_tag);
 }
 
 static void PIN_FAST_ANALYSIS_CALL _xadd_r2m_opq(THREADID tid, ADDRINT dst,
                                                  uint32_t src) {
   tag_t src_tag[] = R64TAG(src);
-  tag_t dst_tag[] = M64TAG(dst);
+  tag_t dst_tag[8];
+  M64TAG(dst, dst_tag);
 
   for (size_t i = 0; i < 8; i++) {
-    tagmap_setb(dst + i, tag_combine(dst_tag[i], src_tag[i]));
+    src_tag[i] = tag_combine(dst_tag[i], src_tag[i]);
     RTAG[src][i] = dst_tag[i];
   }
+  tagmap_setn_tags(dst, 8, src_tag);
 }
 
 void ins_cmpxchg_op(INS ins) {
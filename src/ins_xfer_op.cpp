@@ -1,6 +1,7 @@
 #include "ins_xfer_op.h"
 #include "ins_clear_op.h"
 #include "ins_helper.h"
+#include <string.h>
 
 /* threads context */
 extern thread_ctx_t *threads_ctx;
@@ -61,14 +62,14 @@ void PIN_FAST_ANALYSIS_CALL r2r_xfer_opq(THREADID tid, uint32_t dst,
 
 void PIN_FAST_ANALYSIS_CALL r2r_xfer_opx(THREADID tid, uint32_t dst,
                                          uint32_t src) {
-  for (size_t i = 0; i < 16; i++)
-    RTAG[dst][i] = RTAG[src][i];
+  /* a few vector moves; dst may be src */
+  memmove(RTAG[dst], RTAG[src], 16 * sizeof(tag_t));
 }
 
 void PIN_FAST_ANALYSIS_CALL r2r_xfer_opy(THREADID tid, uint32_t dst,
                                          uint32_t src) {
-  for (size_t i = 0; i < 32; i++)
-    RTAG[dst][i] = RTAG[src][i];
+  /* a few vector moves; dst may be src */
+  memmove(RTAG[dst], RTAG[src], 32 * sizeof(tag_t));
 }
 
 void PIN_FAST_ANALYSIS_CALL m2r_xfer_opb_u(THREADID tid, uint32_t dst,
@@ -87,32 +88,27 @@ void PIN_FAST_ANALYSIS_CALL m2r_xfer_opb_l(THREADID tid, uint32_t dst,
 
 void PIN_FAST_ANALYSIS_CALL m2r_xfer_opw(THREADID tid, uint32_t dst,
                                          ADDRINT src) {
-  for (size_t i = 0; i < 2; i++)
-    RTAG[dst][i] = MTAG(src + i);
+  M16TAG(src, RTAG[dst]);
 }
 
 void PIN_FAST_ANALYSIS_CALL m2r_xfer_opl(THREADID tid, uint32_t dst,
                                          ADDRINT src) {
-  for (size_t i = 0; i < 4; i++)
-    RTAG[dst][i] = MTAG(src + i);
+  M32TAG(src, RTAG[dst]);
 }
 
 void PIN_FAST_ANALYSIS_CALL m2r_xfer_opq(THREADID tid, uint32_t dst,
                                          ADDRINT src) {
-  for (size_t i = 0; i < 8; i++)
-    RTAG[dst][i] = MTAG(src + i);
+  M64TAG(src, RTAG[dst]);
 }
 
 void PIN_FAST_ANALYSIS_CALL m2r_xfer_opx(THREADID tid, uint32_t dst,
                                          ADDRINT src) {
-  for (size_t i = 0; i < 16; i++)
-    RTAG[dst][i] = MTAG(src + i);
+  M128TAG(src, RTAG[dst]);
 }
 
 void PIN_FAST_ANALYSIS_CALL m2r_xfer_opy(THREADID tid, uint32_t dst,
                                          ADDRINT src) {
-  for (size_t i = 0; i < 32; i++)
-    RTAG[dst][i] = MTAG(src + i);
+  M256TAG(src, RTAG[dst]);
 }
 
 void PIN_FAST_ANALYSIS_CALL r2m_xfer_opb_u(THREADID tid, ADDRINT dst,
@@ -131,77 +127,68 @@ void PIN_FAST_ANALYSIS_CALL r2m_xfer_opb_l(THREADID tid, ADDRINT dst,
 
 void PIN_FAST_ANALYSIS_CALL r2m_xfer_opw(THREADID tid, ADDRINT dst,
                                          uint32_t src) {
-  tag_t *src_tags = RTAG[src];
-
-  tagmap_setb(dst, src_tags[0]);
-  tagmap_setb(dst + 1, src_tags[1]);
+  tagmap_setn_tags(dst, 2, RTAG[src]);
 }
 
 void PIN_FAST_ANALYSIS_CALL r2m_xfer_opl(THREADID tid, ADDRINT dst,
                                          uint32_t src) {
-  tag_t *src_tags = RTAG[src];
-
-  for (size_t i = 0; i < 4; i++)
-    tagmap_setb(dst + i, src_tags[i]);
+  tagmap_setn_tags(dst, 4, RTAG[src]);
 }
 
 void PIN_FAST_ANALYSIS_CALL r2m_xfer_opq(THREADID tid, ADDRINT dst,
                                          uint32_t src) {
-  tag_t *src_tags = RTAG[src];
-
-  for (size_t i = 0; i < 8; i++)
-    tagmap_setb(dst + i, src_tags[i]);
+  tagmap_setn_tags(dst, 8, RTAG[src]);
 }
 
 void PIN_FAST_ANALYSIS_CALL r2m_xfer_opx(THREADID tid, ADDRINT dst,
                                          uint32_t src) {
-  tag_t *src_tags = RTAG[src];
-
-  for (size_t i = 0; i < 16; i++)
-    tagmap_setb(dst + i, src_tags[i]);
+  tagmap_setn_tags(dst, 16, RTAG[src]);
 }
 
 void PIN_FAST_ANALYSIS_CALL r2m_xfer_opy(THREADID tid, ADDRINT dst,
                                          uint32_t src) {
-  tag_t *src_tags = RTAG[src];
-
-  for (size_t i = 0; i < 32; i++)
-    tagmap_setb(dst + i, src_tags[i]);
+  tagmap_setn_tags(dst, 32, RTAG[src]);
 }
 
-void PIN_FAST_ANALYSIS_CALL m2m_xfer_opb(ADDRINT dst, ADDRINT src) {
+void PIN_FAST_ANALYSIS_CALL m2m_xfer_opb(THREADID tid, ADDRINT dst,
+                                         ADDRINT src) {
   tag_t src_tag = MTAG(src);
 
   tagmap_setb(dst, src_tag);
 }
 
-void PIN_FAST_ANALYSIS_CALL m2m_xfer_opw(ADDRINT dst, ADDRINT src) {
-  for (size_t i = 0; i < 2; i++)
-    tagmap_setb(dst + i, MTAG(src + i));
+void PIN_FAST_ANALYSIS_CALL m2m_xfer_opw(THREADID tid, ADDRINT dst,
+                                         ADDRINT src) {
+  tag_t src_tags[2];
+
+  MTAGN(src, 2, src_tags);
+  tagmap_setn_tags(dst, 2, src_tags);
 }
 
-void PIN_FAST_ANALYSIS_CALL m2m_xfer_opl(ADDRINT dst, ADDRINT src) {
-  for (size_t i = 0; i < 4; i++)
-    tagmap_setb(dst + i, MTAG(src + i));
+void PIN_FAST_ANALYSIS_CALL m2m_xfer_opl(THREADID tid, ADDRINT dst,
+                                         ADDRINT src) {
+  tag_t src_tags[4];
+
+  MTAGN(src, 4, src_tags);
+  tagmap_setn_tags(dst, 4, src_tags);
 }
 
-void PIN_FAST_ANALYSIS_CALL m2m_xfer_opq(ADDRINT dst, ADDRINT src) {
-  for (size_t i = 0; i < 8; i++)
-    tagmap_setb(dst + i, MTAG(src + i));
+void PIN_FAST_ANALYSIS_CALL m2m_xfer_opq(THREADID tid, ADDRINT dst,
+                                         ADDRINT src) {
+  tag_t src_tags[8];
+
+  MTAGN(src, 8, src_tags);
+  tagmap_setn_tags(dst, 8, src_tags);
 }
 
 void PIN_FAST_ANALYSIS_CALL m2r_xfer_opq_h(THREADID tid, uint32_t dst,
                                            ADDRINT src) {
-  for (size_t i = 0; i < 8; i++)
-    RTAG[dst][i + 8] = MTAG(src + i);
+  M64TAG(src, RTAG[dst] + 8);
 }
 
 void PIN_FAST_ANALYSIS_CALL r2m_xfer_opq_h(THREADID tid, ADDRINT dst,
                                            uint32_t src) {
-  tag_t *src_tags = RTAG[src];
-
-  for (size_t i = 0; i < 8; i++)
-    tagmap_setb(dst + i, src_tags[i + 8]);
+  tagmap_setn_tags(dst, 8, RTAG[src] + 8);
 }
 
 static void PIN_FAST_ANALYSIS_CALL r2m_xfer_opbn(THREADID tid, ADDRINT dst,
@@ -539,41 +526,54 @@ void ins_lea(INS ins) {
 
 void PIN_FAST_ANALYSIS_CALL m2r_xfer_opw_rev(THREADID tid, uint32_t dst,
                                              ADDRINT src) {
+  tag_t buf[2];
+  tag_t const *src_tags = MSPAN(src, 2, buf);
+
   for (size_t i = 0; i < 2; i++)
-    RTAG[dst][i] = MTAG(src + (1 - i));
+    RTAG[dst][i] = src_tags[1 - i];
 }
 
 void PIN_FAST_ANALYSIS_CALL m2r_xfer_opl_rev(THREADID tid, uint32_t dst,
                                              ADDRINT src) {
+  tag_t buf[4];
+  tag_t const *src_tags = MSPAN(src, 4, buf);
+
   for (size_t i = 0; i < 4; i++)
-    RTAG[dst][i] = MTAG(src + (3 - i));
+    RTAG[dst][i] = src_tags[3 - i];
 }
 
 void PIN_FAST_ANALYSIS_CALL m2r_xfer_opq_rev(THREADID tid, uint32_t dst,
                                              ADDRINT src) {
+  tag_t buf[8];
+  tag_t const *src_tags = MSPAN(src, 8, buf);
+
   for (size_t i = 0; i < 8; i++)
-    RTAG[dst][i] = MTAG(src + (7 - i));
+    RTAG[dst][i] = src_tags[7 - i];
 }
 
 void PIN_FAST_ANALYSIS_CALL r2m_xfer_opw_rev(THREADID tid, ADDRINT dst,
                                              uint32_t src) {
-  tag_t *src_tags = RTAG[src];
-  tagmap_setb(dst, src_tags[1]);
-  tagmap_setb(dst + 1, src_tags[0]);
+  tag_t dst_tags[] = {RTAG[src][1], RTAG[src][0]};
+
+  tagmap_setn_tags(dst, 2, dst_tags);
 }
 
 void PIN_FAST_ANALYSIS_CALL r2m_xfer_opl_rev(THREADID tid, ADDRINT dst,
                                              uint32_t src) {
-  tag_t *src_tags = RTAG[src];
+  tag_t dst_tags[4];
+
   for (size_t i = 0; i < 4; i++)
-    tagmap_setb(dst + (3 - i), src_tags[i]);
+    dst_tags[3 - i] = RTAG[src][i];
+  tagmap_setn_tags(dst, 4, dst_tags);
 }
 
 void PIN_FAST_ANALYSIS_CALL r2m_xfer_opq_rev(THREADID tid, ADDRINT dst,
                                              uint32_t src) {
-  tag_t *src_tags = RTAG[src];
+  tag_t dst_tags[8];
+
   for (size_t i = 0; i < 8; i++)
-    tagmap_setb(dst + (7 - i), src_tags[i]);
+    dst_tags[7 - i] = RTAG[src][i];
+  tagmap_setn_tags(dst, 8, dst_tags);
 }
 
 void ins_movbe_op(INS ins) {
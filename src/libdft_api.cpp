@@ -38,7 +38,7 @@
 #include "syscall_hook.h"
 
 /* threads context counter */
-static size_t tctx_ct = 0;
+size_t tctx_ct = 0;
 /* threads context */
 thread_ctx_t *threads_ctx = NULL;
 
@@ -48,6 +48,24 @@ extern syscall_desc_t syscall_desc[SYSCALL_MAX];
 /* ins descriptors */
 ins_desc_t ins_desc[XED_ICLASS_LAST];
 
+/* stack size assumed for the tagmap accounting (default RLIMIT_STACK) */
+#define STACK_SZ (8UL << 20)
+
+/* initial program break; the heap region starts there */
+static ADDRINT heap_start = 0;
+/* current program break */
+static ADDRINT heap_end = 0;
+
+/* how often the collector checks whether tags run low, in milliseconds */
+#ifndef LIBDFT_GC_POLL_MS
+#define LIBDFT_GC_POLL_MS 100
+#endif
+
+/* the collector thread, and whether it should quit */
+static PIN_THREAD_UID gc_uid;
+static THREADID gc_tid = INVALID_THREADID;
+static bool gc_exit = false;
+
 /*
  * thread start callback (analysis function)
  *
@@ -88,6 +106,17 @@ static void thread_alloc(THREADID tid, CONTEXT *ctx, INT32 flags, VOID *v) {
     /* success; patch the counter */
     tctx_ct += THREAD_CTX_BLK;
   }
+
+  /* realloc() does not clear; a zero generation forces a flush */
+  memset(&threads_ctx[tid].page_cache, 0, sizeof(page_cache_t));
+
+  /* charge the tag pages below the initial stack pointer to the stack */
+  ADDRINT const sp = PIN_GetContextReg(ctx, REG_STACK_PTR);
+  tagmap_region_set(sp - STACK_SZ, (sp | OFFSET_MASK) + 1, TAG_REGION_STACK);
+
+  /* the tagmap is shared from now on */
+  if (tid > 0)
+    tagmap_set_threaded();
 }
 
 // thread_free?
@@ -263,6 +292,100 @@ static void sysexit_save(THREADID tid, CONTEXT *ctx, SYSCALL_STANDARD std,
   }
 }
 
+/*
+ * image load/unload callbacks (instrumentation functions)
+ *
+ * keep the image regions of the tagmap accounting current
+ *
+ * @img:	the image
+ * @v:		callback value
+ */
+static void img_load(IMG img, VOID *v) {
+  tagmap_region_set(IMG_LowAddress(img), IMG_HighAddress(img) + 1,
+                    TAG_REGION_IMAGE);
+}
+
+static void img_unload(IMG img, VOID *v) {
+  tagmap_region_clear(IMG_LowAddress(img));
+}
+
+/*
+ * __NR_brk post syscall hook
+ *
+ * keep the heap region of the tagmap accounting current, and give
+ * back the tags of the part a shrinking heap lost; brk never fails,
+ * a refused request returns the current break
+ *
+ * @tid:	thread id
+ * @ctx:	syscall context
+ */
+static void post_brk_hook(THREADID tid, syscall_ctx_t *ctx) {
+  const ADDRINT brk = ctx->ret;
+
+  /* the first call asks for the initial break; the heap starts there */
+  if (heap_start == 0) {
+    heap_start = heap_end = brk;
+    return;
+  }
+  if (brk < heap_end)
+    tagmap_discard(brk, heap_end - brk);
+  if (brk > heap_start)
+    tagmap_region_set(heap_start, brk, TAG_REGION_HEAP);
+  heap_end = brk;
+}
+
+/*
+ * tag collector (Pin internal thread)
+ *
+ * once the tag type runs low on values (e.g., BDD labels), stop the
+ * application threads, which Pin does outside of analysis code, so
+ * that no tag is held anywhere but in the tagmap and the register
+ * tags; the tags in use are collected there and given their new
+ * values
+ *
+ * @arg:	unused
+ */
+static VOID tag_gc_thread(VOID *arg) {
+  THREADID const self = PIN_ThreadId();
+
+  while (!__atomic_load_n(&gc_exit, __ATOMIC_ACQUIRE) &&
+         !PIN_IsProcessExiting()) {
+    PIN_Sleep(LIBDFT_GC_POLL_MS);
+    if (likely(!tag_space_low<tag_t>()))
+      continue;
+    if (unlikely(!PIN_StopApplicationThreads(self, PIN_INFINITE_TIMEOUT)))
+      continue;
+    size_t const reclaimed = tag_collect<tag_t>(tagmap_map_tags);
+    PIN_ResumeApplicationThreads(self);
+    LOG("tags collected: " + decstr(reclaimed) + " reclaimed\n");
+  }
+}
+
+/*
+ * prepare-for-fini callback; the collector has to be gone before the
+ * tool exits
+ *
+ * @v:		callback value
+ */
+static VOID tag_gc_stop(VOID *v) {
+  __atomic_store_n(&gc_exit, true, __ATOMIC_RELEASE);
+  if (gc_tid != INVALID_THREADID)
+    (void)PIN_WaitForThreadTermination(gc_uid, PIN_INFINITE_TIMEOUT, NULL);
+}
+
+/*
+ * fini callback; report the shadow memory used, the chunks of the tag
+ * pools (and how many sit on huge pages) and the tag statistics
+ *
+ * @code:	exit code of the application
+ * @v:		callback value
+ */
+static void libdft_fini(INT32 code, VOID *v) {
+  tagmap_stats_report();
+  tagmap_pool_report();
+  tag_report<tag_t>();
+}
+
 /*
  * trace inspection (instrumentation function)
  *
@@ -365,6 +488,11 @@ int libdft_init() {
   /* initialize symbol processing */
   PIN_InitSymbolsAlt(IFUNC_SYMBOLS);
 
+  /* initialize the tagmap; optimized branch */
+  if (unlikely(tagmap_init()))
+    /* tagmap failed */
+    return 1;
+
   /* initialize thread contexts; optimized branch */
   if (unlikely(thread_ctx_init()))
     /* thread contexts failed */
@@ -381,12 +509,28 @@ int libdft_init() {
   /* register sysexit_save() to be called after every syscall */
   PIN_AddSyscallExitFunction(sysexit_save, NULL);
 
+  /* every tool gets the heap accounting, not only the ones with hooks */
+  (void)syscall_set_post(&syscall_desc[__NR_brk], post_brk_hook);
+
   /* initialize the ins descriptors */
   (void)memset(ins_desc, 0, sizeof(ins_desc));
 
   /* register trace_ins() to be called for every trace */
   TRACE_AddInstrumentFunction(trace_inspect, NULL);
 
+  /* shadow memory accounting */
+  IMG_AddInstrumentFunction(img_load, NULL);
+  IMG_AddUnloadFunction(img_unload, NULL);
+  PIN_AddFiniFunction(libdft_fini, NULL);
+
+  /* collect the tags when they run low; taint is lost without it */
+  gc_tid = PIN_SpawnInternalThread(tag_gc_thread, NULL,
+                                   DEFAULT_THREAD_STACK_SIZE, &gc_uid);
+  if (unlikely(gc_tid == INVALID_THREADID))
+    LOG("Failed to start the tag collector!\n");
+  else
+    PIN_AddPrepareForFiniFunction(tag_gc_stop, NULL);
+
   /* success */
   return 0;
 }
@@ -70,6 +70,7 @@ typedef struct {
   vcpu_ctx_t vcpu;           /* VCPU context */
   syscall_ctx_t syscall_ctx; /* syscall context */
   UINT32 syscall_nr;
+  page_cache_t page_cache;   /* recently used tag pages */
 } thread_ctx_t;
 
 /* instruction (ins) descriptor */
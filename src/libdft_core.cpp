@@ -54,9 +54,7 @@ static void PIN_FAST_ANALYSIS_CALL m2r_restore_opw(THREADID tid, ADDRINT src) {
     if (i == DFT_REG_RSP)
       continue;
     size_t offset = (i < DFT_REG_RSP) ? (i << 1) : ((i - 1) << 1);
-    tag_t src_tag[] = M16TAG(src + offset);
-    RTAG[DFT_REG_RDI + i][0] = src_tag[0];
-    RTAG[DFT_REG_RDI + i][1] = src_tag[1];
+    M16TAG(src + offset, RTAG[DFT_REG_RDI + i]);
   }
 }
 
@@ -65,11 +63,7 @@ static void PIN_FAST_ANALYSIS_CALL m2r_restore_opl(THREADID tid, ADDRINT src) {
     if (i == DFT_REG_RSP)
       continue;
     size_t offset = (i < DFT_REG_RSP) ? (i << 2) : ((i - 1) << 2);
-    tag_t src_tag[] = M32TAG(src + offset);
-    RTAG[DFT_REG_RDI + i][0] = src_tag[0];
-    RTAG[DFT_REG_RDI + i][1] = src_tag[1];
-    RTAG[DFT_REG_RDI + i][2] = src_tag[2];
-    RTAG[DFT_REG_RDI + i][3] = src_tag[3];
+    M32TAG(src + offset, RTAG[DFT_REG_RDI + i]);
   }
 }
 
@@ -78,10 +72,7 @@ static void PIN_FAST_ANALYSIS_CALL r2m_save_opw(THREADID tid, ADDRINT dst) {
     if (i == DFT_REG_RSP)
       continue;
     size_t offset = (i < DFT_REG_RSP) ? (i << 1) : ((i - 1) << 1);
-    tag_t src_tag[] = R16TAG(i);
-
-    tagmap_setb(dst + offset, src_tag[0]);
-    tagmap_setb(dst + offset + 1, src_tag[1]);
+    tagmap_setn_tags(dst + offset, 2, RTAG[i]);
   }
 }
 
@@ -90,10 +81,7 @@ static void PIN_FAST_ANALYSIS_CALL r2m_save_opl(THREADID tid, ADDRINT dst) {
     if (i == DFT_REG_RSP)
       continue;
     size_t offset = (i < DFT_REG_RSP) ? (i << 2) : ((i - 1) << 2);
-    tag_t src_tag[] = R32TAG(i);
-
-    for (size_t j = 0; j < 4; j++)
-      tagmap_setb(dst + offset + j, src_tag[j]);
+    tagmap_setn_tags(dst + offset, 4, RTAG[i]);
   }
 }
 
@@ -7,7 +7,9 @@
 #include "tagmap.h"
 
 #include <iostream>
+#include <map>
 #include <set>
+#include <sys/mman.h>
 #include <sys/syscall.h>
 #include <unistd.h>
 
@@ -18,6 +20,45 @@ std::set<int> fuzzing_fd_set;
 static unsigned int stdin_read_off = 0;
 static bool tainted = false;
 
+/*
+ * mappings whose contents survive MADV_DONTNEED (file-backed or
+ * shared ones), as start -> end; only anonymous private memory is
+ * zero-filled by it
+ */
+static std::map<ADDRINT, ADDRINT> kept_maps;
+static PIN_MUTEX kept_maps_lock;
+
+/*
+ * forget [start, end) in kept_maps (kept_maps_lock held)
+ */
+static void kept_maps_remove(ADDRINT start, ADDRINT end) {
+  std::map<ADDRINT, ADDRINT>::iterator it = kept_maps.lower_bound(start);
+  if (it != kept_maps.begin()) {
+    std::map<ADDRINT, ADDRINT>::iterator prev = it;
+    --prev;
+    if (prev->second > start) {
+      /* keep the head, and the tail past end */
+      if (prev->second > end)
+        kept_maps[end] = prev->second;
+      prev->second = start;
+    }
+  }
+  while (it != kept_maps.end() && it->first < end) {
+    if (it->second > end)
+      kept_maps[end] = it->second;
+    kept_maps.erase(it++);
+  }
+}
+
+/*
+ * check whether [start, end) overlaps a kept mapping
+ * (kept_maps_lock held)
+ */
+static bool kept_maps_overlap(ADDRINT start, ADDRINT end) {
+  std::map<ADDRINT, ADDRINT>::const_iterator it = kept_maps.lower_bound(end);
+  return it != kept_maps.begin() && (--it)->second > start;
+}
+
 inline bool is_tainted() { return tainted; }
 
 static inline bool is_fuzzing_fd(int fd) {
@@ -172,8 +213,18 @@ static void post_mmap_hook(THREADID tid, syscall_ctx_t *ctx) {
   const ADDRINT ret = ctx->ret;
   const int fd = ctx->arg[SYSCALL_ARG4];
   const int prot = ctx->arg[SYSCALL_ARG2];
+  const int flags = ctx->arg[SYSCALL_ARG3];
+  /* the raw syscall fails with -errno; nothing was mapped then */
+  if ((long)ret < 0 && (long)ret >= -4095)
+    return;
+  /* a fixed mapping replaces whatever was there */
+  PIN_MutexLock(&kept_maps_lock);
+  kept_maps_remove(ret, ret + ctx->arg[SYSCALL_ARG1]);
+  if (!(flags & MAP_ANONYMOUS) || (flags & MAP_SHARED))
+    kept_maps[ret] = ret + ctx->arg[SYSCALL_ARG1];
+  PIN_MutexUnlock(&kept_maps_lock);
   // PROT_READ 0x1
-  if ((void *)ret == (void *)-1 || !(prot & 0x1))
+  if (!(prot & 0x1))
     return;
   const ADDRINT buf = ctx->arg[SYSCALL_ARG0];
   const size_t nr = ctx->arg[SYSCALL_ARG1];
@@ -192,18 +243,41 @@ static void post_mmap_hook(THREADID tid, syscall_ctx_t *ctx) {
   }
 }
 
+/* __NR_munmap post syscall hook */
 static void post_munmap_hook(THREADID tid, syscall_ctx_t *ctx) {
-  const ADDRINT ret = ctx->ret;
-  if ((void *)ret == (void *)-1)
+  /* the raw syscall fails with -errno; the range is still mapped then */
+  if (ctx->ret != 0)
     return;
   const ADDRINT buf = ctx->arg[SYSCALL_ARG0];
   const size_t nr = ctx->arg[SYSCALL_ARG1];
 
   // std::cerr <<"[munmap] addr: " << buf << ", nr: "<< nr << std::endl;
-  tagmap_clrn(buf, nr);
+  PIN_MutexLock(&kept_maps_lock);
+  kept_maps_remove(buf, buf + nr);
+  PIN_MutexUnlock(&kept_maps_lock);
+  /* the tag pages of the range go back to the pool */
+  tagmap_discard(buf, nr);
+}
+
+// int madvise(void *addr, size_t length, int advice);
+/* __NR_madvise post syscall hook */
+static void post_madvise_hook(THREADID tid, syscall_ctx_t *ctx) {
+  if (ctx->ret != 0 || (int)ctx->arg[SYSCALL_ARG2] != MADV_DONTNEED)
+    return;
+  const ADDRINT buf = ctx->arg[SYSCALL_ARG0];
+  const size_t nr = ctx->arg[SYSCALL_ARG1];
+
+  /* anonymous private memory reads as zeros from now on */
+  PIN_MutexLock(&kept_maps_lock);
+  const bool kept = kept_maps_overlap(buf, buf + nr);
+  PIN_MutexUnlock(&kept_maps_lock);
+  if (!kept)
+    tagmap_discard(buf, nr);
 }
 
 void hook_file_syscall() {
+  (void)PIN_MutexInit(&kept_maps_lock);
+
   (void)syscall_set_post(&syscall_desc[__NR_open], post_open_hook);
   (void)syscall_set_post(&syscall_desc[__NR_openat], post_openat_hook);
   (void)syscall_set_post(&syscall_desc[__NR_dup], post_dup_hook);
@@ -215,4 +289,5 @@ void hook_file_syscall() {
   (void)syscall_set_post(&syscall_desc[__NR_pread64], post_pread64_hook);
   (void)syscall_set_post(&syscall_desc[__NR_mmap], post_mmap_hook);
   (void)syscall_set_post(&syscall_desc[__NR_munmap], post_munmap_hook);
+  (void)syscall_set_post(&syscall_desc[__NR_madvise], post_madvise_hook);
 }
\ No newline at end of file
@@ -0,0 +1,179 @@
+/*-
+ * Copyright (c) 2010, Columbia University
+ * All rights reserved.
+ *
+ * This software was developed by Vasileios P. Kemerlis <vpk@cs.columbia.edu>
+ * at Columbia University, New York, NY, USA, in June 2010.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Columbia University nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "tag_pool.h"
+#include "branch_pred.h"
+#include "debug.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#define POOL_ALIGN 64 /* objects start on a cache line */
+
+#define POOL_LINK(pool, obj) ((void **)((char *)(obj) + (pool)->link_off))
+
+#if defined(LIBDFT_HUGE_PAGES) && !defined(_WIN32)
+/*
+ * map a chunk that transparent huge pages can back; it is aligned to
+ * its size, which is that of a huge page
+ */
+static inline char *tag_pool_chunk_alloc_thp(void) {
+  char *p = (char *)mmap(NULL, 2 * TAG_POOL_CHUNK_SZ, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (unlikely(p == MAP_FAILED))
+    return NULL;
+  /* trim the unaligned head and the tail */
+  char *chunk = (char *)(((uintptr_t)p + TAG_POOL_CHUNK_SZ - 1) &
+                         ~(uintptr_t)(TAG_POOL_CHUNK_SZ - 1));
+  if (chunk != p)
+    (void)munmap(p, chunk - p);
+  (void)munmap(chunk + TAG_POOL_CHUNK_SZ, p + TAG_POOL_CHUNK_SZ - chunk);
+#ifdef MADV_HUGEPAGE
+  /* a hint; the kernel may not have THP enabled */
+  (void)madvise(chunk, TAG_POOL_CHUNK_SZ, MADV_HUGEPAGE);
+#endif
+  return chunk;
+}
+#endif
+
+/*
+ * map a new chunk of zero-filled memory for @pool
+ *
+ * with LIBDFT_HUGE_PAGES, a reserved huge page (MAP_HUGETLB) is tried
+ * first, then an aligned chunk for transparent huge pages; once the
+ * reserve runs dry, the pool stops asking for it
+ */
+static inline char *tag_pool_chunk_alloc(tag_pool_t *pool) {
+#ifndef _WIN32
+#ifdef LIBDFT_HUGE_PAGES
+#ifdef MAP_HUGETLB
+  if (!pool->no_hugetlb) {
+    void *h = mmap(NULL, TAG_POOL_CHUNK_SZ, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (h != MAP_FAILED) {
+      pool->nr_huge++;
+      return (char *)h;
+    }
+    pool->no_hugetlb = true;
+  }
+#endif
+  char *chunk = tag_pool_chunk_alloc_thp();
+  if (chunk != NULL)
+    return chunk;
+#endif
+  void *p = mmap(NULL, TAG_POOL_CHUNK_SZ, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return (p == MAP_FAILED) ? NULL : (char *)p;
+#else  // _WIN32
+  return (char *)calloc(1, TAG_POOL_CHUNK_SZ);
+#endif
+}
+
+/*
+ * initialize @pool for objects of @obj_sz bytes
+ *
+ * returns: 0 on success, 1 on error
+ */
+int tag_pool_init(tag_pool_t *pool, size_t obj_sz) {
+  memset(pool, 0, sizeof(*pool));
+  /* the free link lives past the object, so released objects keep
+   * their contents */
+  pool->link_off = (obj_sz + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+  pool->obj_sz =
+      (pool->link_off + sizeof(void *) + POOL_ALIGN - 1) & ~(POOL_ALIGN - 1);
+  if (unlikely(pool->obj_sz > TAG_POOL_CHUNK_SZ))
+    return 1;
+  return PIN_MutexInit(&pool->lock) ? 0 : 1;
+}
+
+/*
+ * get an object from @pool; recycled objects are preferred
+ *
+ * returns: the object, or NULL if no memory is left
+ */
+void *tag_pool_get(tag_pool_t *pool) {
+  void *obj;
+
+  PIN_MutexLock(&pool->lock);
+  if (pool->free != NULL) {
+    obj = pool->free;
+    pool->free = *POOL_LINK(pool, obj);
+    pool->nr_free--;
+  } else {
+    /* the current chunk is used up; optimized branch */
+    if (unlikely(pool->cur + pool->obj_sz > pool->end)) {
+      char *chunk = tag_pool_chunk_alloc(pool);
+      if (unlikely(chunk == NULL)) {
+        PIN_MutexUnlock(&pool->lock);
+        return NULL;
+      }
+      pool->cur = chunk;
+      pool->end = chunk + TAG_POOL_CHUNK_SZ;
+      pool->nr_chunks++;
+    }
+    obj = pool->cur;
+    pool->cur += pool->obj_sz;
+  }
+  pool->nr_live++;
+  PIN_MutexUnlock(&pool->lock);
+
+  return obj;
+}
+
+/*
+ * return @obj to @pool
+ */
+void tag_pool_put(tag_pool_t *pool, void *obj) {
+  PIN_MutexLock(&pool->lock);
+  *POOL_LINK(pool, obj) = pool->free;
+  pool->free = obj;
+  pool->nr_free++;
+  pool->nr_live--;
+  PIN_MutexUnlock(&pool->lock);
+}
+
+/*
+ * log the chunk usage of @pool
+ */
+void tag_pool_report(tag_pool_t *pool, const char *name) {
+  PIN_MutexLock(&pool->lock);
+  size_t const per_chunk = TAG_POOL_CHUNK_SZ / pool->obj_sz;
+  LOG(std::string(name) + ": " + decstr(pool->nr_chunks) + " chunks (" +
+      decstr(pool->nr_chunks * (TAG_POOL_CHUNK_SZ >> 10)) + " KB), " +
+      decstr(pool->nr_live) + " live, " + decstr(pool->nr_free) + " free, " +
+      decstr(pool->nr_chunks * per_chunk - pool->nr_live - pool->nr_free) +
+      " uncarved, " + decstr(pool->nr_huge) + " on reserved huge pages\n");
+  PIN_MutexUnlock(&pool->lock);
+}
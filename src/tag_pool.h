@@ -0,0 +1,71 @@
+/*-
+ * Copyright (c) 2010, Columbia University
+ * All rights reserved.
+ *
+ * This software was developed by Vasileios P. Kemerlis <vpk@cs.columbia.edu>
+ * at Columbia University, New York, NY, USA, in June 2010.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Columbia University nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __TAG_POOL_H__
+#define __TAG_POOL_H__
+
+#include "pin.H"
+
+/*
+ * fixed-size object pool for the tagmap
+ *
+ * objects are carved out of large anonymous chunks and recycled
+ * through a free list; chunks are never given back. An object carved
+ * from a fresh chunk is zero-filled, while a recycled one holds
+ * whatever it was released with.
+ *
+ * chunks are the size of an x86-64 huge page; build with
+ * -DLIBDFT_HUGE_PAGES to back them with huge pages, cutting the dTLB
+ * misses taken on the shadow memory.
+ */
+#define TAG_POOL_CHUNK_SZ (1UL << 21) /* 2MB */
+
+typedef struct {
+  size_t obj_sz;    /* stride of an object, including its free link */
+  size_t link_off;  /* offset of the free link within an object */
+  char *cur;        /* next uncarved object of the current chunk */
+  char *end;        /* end of the current chunk */
+  void *free;       /* released objects */
+  size_t nr_chunks; /* chunks mapped */
+  size_t nr_live;   /* objects handed out */
+  size_t nr_free;   /* objects on the free list */
+  size_t nr_huge;   /* chunks on reserved huge pages (MAP_HUGETLB) */
+  bool no_hugetlb;  /* the huge page reserve ran dry */
+  PIN_MUTEX lock;
+} tag_pool_t;
+
+int tag_pool_init(tag_pool_t *pool, size_t obj_sz);
+void *tag_pool_get(tag_pool_t *pool);
+void tag_pool_put(tag_pool_t *pool, void *obj);
+void tag_pool_report(tag_pool_t *pool, const char *name);
+
+#endif /* __TAG_POOL_H__ */
@@ -0,0 +1,165 @@
+/*-
+ * Copyright (c) 2010, Columbia University
+ * All rights reserved.
+ *
+ * This software was developed by Vasileios P. Kemerlis <vpk@cs.columbia.edu>
+ * at Columbia University, New York, NY, USA, in June 2010.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Columbia University nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "tag_simd.h"
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define TAG_SIMD_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+static uint8_t or_scalar(uint8_t const *tags, size_t n) {
+  uint8_t ts = 0;
+  for (size_t i = 0; i < n; i++)
+    ts |= tags[i];
+  return ts;
+}
+
+static size_t count_zero_scalar(uint8_t const *tags, size_t n) {
+  size_t nr = 0;
+  for (size_t i = 0; i < n; i++)
+    nr += (tags[i] == 0);
+  return nr;
+}
+
+#ifdef TAG_SIMD_X86
+/*
+ * fold the 16 bytes of @v into one
+ */
+static inline uint8_t or_fold128(__m128i v) {
+  v = _mm_or_si128(v, _mm_srli_si128(v, 8));
+  v = _mm_or_si128(v, _mm_srli_si128(v, 4));
+  v = _mm_or_si128(v, _mm_srli_si128(v, 2));
+  v = _mm_or_si128(v, _mm_srli_si128(v, 1));
+  return (uint8_t)_mm_cvtsi128_si32(v);
+}
+
+static uint8_t or_sse2(uint8_t const *tags, size_t n) {
+  __m128i acc = _mm_setzero_si128();
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16)
+    acc = _mm_or_si128(acc, _mm_loadu_si128((__m128i const *)(tags + i)));
+  return or_fold128(acc) | or_scalar(tags + i, n - i);
+}
+
+static size_t count_zero_sse2(uint8_t const *tags, size_t n) {
+  __m128i const zero = _mm_setzero_si128();
+  size_t nr = 0;
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((__m128i const *)(tags + i));
+    nr += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)));
+  }
+  return nr + count_zero_scalar(tags + i, n - i);
+}
+
+__attribute__((target("avx2"))) static uint8_t or_avx2(uint8_t const *tags,
+                                                        size_t n) {
+  __m256i acc = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32)
+    acc = _mm256_or_si256(acc,
+                          _mm256_loadu_si256((__m256i const *)(tags + i)));
+  __m128i v = _mm_or_si128(_mm256_castsi256_si128(acc),
+                           _mm256_extracti128_si256(acc, 1));
+  return or_fold128(v) | or_sse2(tags + i, n - i);
+}
+
+__attribute__((target("avx2,popcnt"))) static size_t
+count_zero_avx2(uint8_t const *tags, size_t n) {
+  __m256i const zero = _mm256_setzero_si256();
+  size_t nr = 0;
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i v = _mm256_loadu_si256((__m256i const *)(tags + i));
+    nr += __builtin_popcount(
+        (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero)));
+  }
+  return nr + count_zero_sse2(tags + i, n - i);
+}
+
+/*
+ * check whether the CPU has AVX2 and the OS saves the YMM state
+ */
+static bool cpu_has_avx2(void) {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    return false;
+  /* OSXSAVE and AVX */
+  if ((ecx & (1U << 27)) == 0 || (ecx & (1U << 28)) == 0)
+    return false;
+  /* XCR0: SSE and AVX state */
+  unsigned int lo, hi;
+  __asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+  if ((lo & 0x6) != 0x6)
+    return false;
+  if (__get_cpuid_max(0, NULL) < 7)
+    return false;
+  __cpuid_count(7, 0, eax, ebx, ecx, edx);
+  /* AVX2; POPCNT comes with every CPU that has it */
+  return (ebx & (1U << 5)) != 0;
+}
+
+static uint8_t (*or_kernel)(uint8_t const *, size_t) = or_sse2;
+static size_t (*count_zero_kernel)(uint8_t const *, size_t) = count_zero_sse2;
+static const char *kernel_name = "sse2";
+#else
+static uint8_t (*or_kernel)(uint8_t const *, size_t) = or_scalar;
+static size_t (*count_zero_kernel)(uint8_t const *,
+                                   size_t) = count_zero_scalar;
+static const char *kernel_name = "scalar";
+#endif
+
+/*
+ * pick the widest kernels the CPU supports; until this is called,
+ * the baseline ones are used
+ */
+void tag_simd_init(void) {
+#ifdef TAG_SIMD_X86
+  if (cpu_has_avx2()) {
+    or_kernel = or_avx2;
+    count_zero_kernel = count_zero_avx2;
+    kernel_name = "avx2";
+  }
+#endif
+}
+
+const char *tag_simd_name(void) { return kernel_name; }
+
+uint8_t tag_simd_or(uint8_t const *tags, size_t n) {
+  return or_kernel(tags, n);
+}
+
+size_t tag_simd_count_zero(uint8_t const *tags, size_t n) {
+  return count_zero_kernel(tags, n);
+}
@@ -1,10 +1,13 @@
 #include "pin.H"
 #include "tag_traits.h"
+#include "tag_simd.h"
 #include <string.h>
 
 /********************************************************
  uint8_t tags
  ********************************************************/
+const uint8_t tag_traits<uint8_t>::cleared_val;
+
 template <> uint8_t tag_combine(uint8_t const &lhs, uint8_t const &rhs) {
   return lhs | rhs;
 }
@@ -19,6 +22,27 @@ template <> uint8_t tag_alloc<uint8_t>(unsigned int offset) {
   return offset > 0;
 }
 
+/* nothing to report; byte tags keep no state */
+template <> void tag_report<uint8_t>(void) {}
+
+/* there are only 256 of them, and they are never allocated */
+template <> bool tag_space_low<uint8_t>(void) { return false; }
+
+template <>
+size_t tag_collect<uint8_t>(void (*roots)(uint8_t (*)(uint8_t, void *),
+                                          void *)) {
+  return 0;
+}
+
+template <>
+uint8_t tag_combine_n(uint8_t const *tags, size_t n, uint8_t ts) {
+  return ts | tag_simd_or(tags, n);
+}
+
+template <> size_t tag_count_cleared(uint8_t const *tags, size_t n) {
+  return tag_simd_count_zero(tags, n);
+}
+
 /********************************************************
 tag set tags
 ********************************************************/
@@ -38,4 +62,34 @@ template <> lb_type tag_alloc<lb_type>(unsigned int offset) {
   return bdd_tag.insert(offset);
 }
 
-std::vector<tag_seg> tag_get(lb_type t) { return bdd_tag.find(t); }
\ No newline at end of file
+void tag_visit(lb_type t, bdd_seg_fn fn, void *arg) {
+  bdd_tag.visit(t, fn, arg);
+}
+
+std::vector<tag_seg> tag_get(lb_type t) { return bdd_tag.find(t); }
+
+/*
+ * log how well the combine cache does, what collection got back, and
+ * the memory the tree takes
+ */
+template <> void tag_report<lb_type>(void) {
+  uint64_t hits, misses, runs, reclaimed, live, nodes, peak, cache;
+  bdd_tag.combine_stats(&hits, &misses);
+  bdd_tag.gc_stats(&runs, &reclaimed, &live);
+  bdd_tag.mem_stats(&nodes, &peak, &cache);
+  LOG("bdd tags: combine cache " + decstr(hits) + " hits, " + decstr(misses) +
+      " misses\n");
+  LOG("bdd tags: " + decstr(live) + " nodes, " + decstr(runs) +
+      " collections, " + decstr(reclaimed) + " nodes reclaimed\n");
+  LOG("bdd tags: " + decstr(nodes >> 10) + " KB of nodes (peak " +
+      decstr(peak >> 10) + " KB), " + decstr(cache >> 10) +
+      " KB of combine cache\n");
+}
+
+template <> bool tag_space_low<lb_type>(void) {
+  return bdd_tag.low_on_labels();
+}
+
+template <> size_t tag_collect<lb_type>(bdd_roots_fn roots) {
+  return bdd_tag.collect(roots);
+}
\ No newline at end of file
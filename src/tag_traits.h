@@ -1,11 +1,34 @@
 #ifndef LIBDFT_TAG_TRAITS_H
 #define LIBDFT_TAG_TRAITS_H
 
+#include <algorithm>
+#include <stddef.h>
 #include <string>
 template <typename T> struct tag_traits {};
 template <typename T> T tag_combine(T const &lhs, T const &rhs);
 template <typename T> std::string tag_sprint(T const &tag);
 template <typename T> T tag_alloc(unsigned int offset);
+template <typename T> void tag_report(void);
+/*
+ * tag types that run out of values can be collected: @roots passes
+ * every tag in use to @fn and stores back what it returns
+ */
+template <typename T> bool tag_space_low(void);
+template <typename T>
+size_t tag_collect(void (*roots)(T (*fn)(T, void *), void *arg));
+
+/* combine the @n tags at @tags into @ts, skipping the cleared ones */
+template <typename T> T tag_combine_n(T const *tags, size_t n, T ts) {
+  for (size_t i = 0; i < n; i++)
+    if (!(tags[i] == tag_traits<T>::cleared_val))
+      ts = tag_combine(ts, tags[i]);
+  return ts;
+}
+
+/* count the cleared tags among the @n at @tags */
+template <typename T> size_t tag_count_cleared(T const *tags, size_t n) {
+  return std::count(tags, tags + n, tag_traits<T>::cleared_val);
+}
 
 /********************************************************
  uint8_t tags
@@ -20,6 +43,15 @@ template <> struct tag_traits<unsigned char> {
 template <> uint8_t tag_combine(uint8_t const &lhs, uint8_t const &rhs);
 template <> std::string tag_sprint(uint8_t const &tag);
 template <> uint8_t tag_alloc<uint8_t>(unsigned int offset);
+template <> void tag_report<uint8_t>(void);
+template <> bool tag_space_low<uint8_t>(void);
+template <>
+size_t tag_collect<uint8_t>(void (*roots)(uint8_t (*)(uint8_t, void *),
+                                          void *));
+/* vector kernels; see tag_simd.h */
+template <>
+uint8_t tag_combine_n(uint8_t const *tags, size_t n, uint8_t ts);
+template <> size_t tag_count_cleared(uint8_t const *tags, size_t n);
 // template <> uint8_t tag_get<uint8_t>(uint8_t);
 
 /********************************************************
@@ -38,8 +70,13 @@ template <> lb_type tag_combine(lb_type const &lhs, lb_type const &rhs);
 // template <> void tag_combine_inplace(lb_type &lhs, lb_type const &rhs);
 template <> std::string tag_sprint(lb_type const &tag);
 template <> lb_type tag_alloc<lb_type>(unsigned int offset);
+template <> void tag_report<lb_type>(void);
+template <> bool tag_space_low<lb_type>(void);
+template <> size_t tag_collect<lb_type>(bdd_roots_fn roots);
 
 std::vector<tag_seg> tag_get(lb_type);
+/* the segments of a tag, in order, without allocating; see bdd_tag.h */
+void tag_visit(lb_type, bdd_seg_fn fn, void *arg);
 
 /********************************************************
 others
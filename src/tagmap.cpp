@@ -37,53 +37,522 @@
 #include "debug.h"
 #include "libdft_api.h"
 #include "pin.H"
+#include "tag_pool.h"
+#include "tag_simd.h"
 #include <err.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 
-tag_dir_t tag_dir;
 extern thread_ctx_t *threads_ctx;
+extern size_t tctx_ct;
+
+/* the interval backend lives in tagmap_interval.cpp */
+#if LIBDFT_TAGMAP != libdft_tagmap_interval
+
+#if LIBDFT_TAGMAP == libdft_tagmap_direct && defined(_WIN32)
+#error "the direct-mapped tagmap needs mmap(2)"
+#endif
+
+/*
+ * the tag_dir_* helpers below work on tag indices, i.e. VIRT2TAG(addr);
+ * with one tag per byte these are plain addresses
+ */
+#if LIBDFT_TAGMAP == libdft_tagmap_pagetable
+/*
+ * the top-level directory is reserved in tagmap_init() rather than
+ * living in BSS; only the parts of it that hold tables get backed
+ */
+tag_dir_t *tag_dir = NULL;
+#else
+/*
+ * direct-mapped backend: one page pointer for every page of the user
+ * address space, reserved once and indexed by (addr >> PAGE_BITS);
+ * the kernel backs the parts that are written with zero pages, so a
+ * NULL slot stands for an untainted page
+ */
+#define TAG_MAP_SZ ((TAG_IDX_MAX + 1) >> PAGE_BITS)
+tag_page_t **tag_map = NULL;
+#endif
+
+/*
+ * the shared page of cleared tags; every slot of a tag table that has
+ * no tainted byte points to it, and it is mapped read-only
+ */
+tag_page_t *clean_page = NULL;
+
+/*
+ * the value of a slot that has no private page; reads resolve it
+ * to the clean page
+ */
+#if LIBDFT_TAGMAP == libdft_tagmap_pagetable
+#define CLEAN_SLOT clean_page
+#define SLOT2PAGE(page) (page)
+#else
+#define CLEAN_SLOT NULL
+#define SLOT2PAGE(page) ((page) ? (page) : clean_page)
+#endif
+
+/* backing store of tag pages and tag tables */
+static tag_pool_t page_pool;
+static tag_pool_t table_pool;
+
+/*
+ * set if zero-filled memory reads as cleared tags; pages carved
+ * from a fresh chunk then need no fill
+ */
+static bool pool_zero_clean = false;
+
+/*
+ * bumped whenever a slot changes page; the per-thread page caches
+ * are only valid for the generation they were filled in
+ */
+UINT64 tagmap_gen = 1;
+
+/*
+ * set once the application runs more than one thread; from then on a
+ * page that loses its last tainted byte stays installed, since another
+ * thread may still hold a pointer to it
+ */
+static bool tagmap_threaded = false;
+
+/*
+ * journal of the slots that got a private page since the last
+ * tagmap_reset(); duplicates are squeezed out whenever it doubles
+ */
+static std::vector<tag_page_t **> journal;
+static size_t journal_compact_at = 1024;
+static PIN_MUTEX journal_lock;
+
+/*
+ * snapshot state; pages of an older epoch belong to the snapshot and
+ * are copied before they are written. The undo log records what each
+ * slot held before it was first changed after the snapshot.
+ */
+typedef struct {
+  tag_page_t **slot;
+  tag_page_t *page;
+} tag_undo_t;
+
+static UINT32 tagmap_epoch = 0;
+static bool snap_active = false;
+static std::vector<tag_undo_t> undo_log;
+static size_t undo_compact_at = 1024;
+
+static inline bool tag_undo_cmp(tag_undo_t const &lhs, tag_undo_t const &rhs) {
+  return lhs.slot < rhs.slot;
+}
+
+static inline void tag_page_put(tag_page_t *page);
+
+/*
+ * log that @slot held @page at snapshot time; only the first entry
+ * of a slot matters, later ones are squeezed out whenever the log
+ * doubles (journal_lock held)
+ */
+static inline void tag_undo_add(tag_page_t **slot, tag_page_t *page) {
+  tag_undo_t const u = {slot, page};
+  undo_log.push_back(u);
+  if (unlikely(undo_log.size() >= undo_compact_at)) {
+    std::stable_sort(undo_log.begin(), undo_log.end(), tag_undo_cmp);
+    size_t nr = 0;
+    for (size_t i = 0; i < undo_log.size(); i++) {
+      if (nr > 0 && undo_log[nr - 1].slot == undo_log[i].slot) {
+        /* a uniform page replaced later; drop the reference it kept */
+        tag_page_t *old = undo_log[i].page;
+        if (old != CLEAN_SLOT && old->refs)
+          tag_page_put(old);
+        continue;
+      }
+      undo_log[nr++] = undo_log[i];
+    }
+    undo_log.resize(nr);
+    undo_compact_at = std::max((size_t)1024, 2 * undo_log.size());
+  }
+}
+
+static inline void tag_journal_add(tag_page_t **slot) {
+  PIN_MutexLock(&journal_lock);
+  if (snap_active)
+    tag_undo_add(slot, CLEAN_SLOT);
+  journal.push_back(slot);
+  if (unlikely(journal.size() >= journal_compact_at)) {
+    std::sort(journal.begin(), journal.end());
+    journal.erase(std::unique(journal.begin(), journal.end()), journal.end());
+    journal_compact_at = std::max((size_t)1024, 2 * journal.size());
+  }
+  PIN_MutexUnlock(&journal_lock);
+}
+
+/*
+ * uniform pages: one shared, reference-counted page per tag value
+ * (other than the cleared one) that fills whole pages. The table is
+ * capped; past that, fully covered pages get private copies.
+ */
+#define UNIFORM_MAX 4096
+static std::map<tag_t, tag_page_t *> uniform_pages;
+static PIN_MUTEX uniform_lock;
+
+/* shadow memory accounting; updated atomically */
+static tagmap_stats_t tag_stats;
+
+/*
+ * raise the high-water mark @peak to @val
+ */
+static inline void tag_stats_max(UINT64 *peak, UINT64 val) {
+  UINT64 cur = __atomic_load_n(peak, __ATOMIC_RELAXED);
+  while (cur < val && !__atomic_compare_exchange_n(peak, &cur, val, true,
+                                                   __ATOMIC_RELAXED,
+                                                   __ATOMIC_RELAXED))
+    ;
+}
+
+static inline void tag_stats_bytes(INT64 delta) {
+  UINT64 const bytes =
+      __atomic_add_fetch(&tag_stats.bytes, (UINT64)delta, __ATOMIC_RELAXED);
+  if (delta > 0)
+    tag_stats_max(&tag_stats.bytes_peak, bytes);
+}
+
+/*
+ * account for a new tag page of @region
+ */
+static inline void tag_page_charge(tag_page_t *page, UINT32 region) {
+  page->region = region;
+  tag_stats_max(&tag_stats.pages_peak,
+                __atomic_add_fetch(&tag_stats.pages, 1, __ATOMIC_RELAXED));
+  tag_stats_max(&tag_stats.region_peak[region],
+                __atomic_add_fetch(&tag_stats.region_pages[region], 1,
+                                   __ATOMIC_RELAXED));
+  tag_stats_bytes(sizeof(tag_page_t));
+}
 
-inline void tag_dir_setb(tag_dir_t &dir, ADDRINT addr, tag_t const &tag) {
-  if (addr > 0x7fffffffffff) {
+/*
+ * account for a tag page that goes back to the pool
+ */
+static inline void tag_page_uncharge(tag_page_t *page) {
+  __atomic_sub_fetch(&tag_stats.pages, 1, __ATOMIC_RELAXED);
+  __atomic_sub_fetch(&tag_stats.region_pages[page->region], 1,
+                     __ATOMIC_RELAXED);
+  __atomic_add_fetch(&tag_stats.pages_reclaimed, 1, __ATOMIC_RELAXED);
+  tag_stats_bytes(-(INT64)sizeof(tag_page_t));
+}
+
+static inline tag_table_t *tag_table_alloc(void) {
+  tag_table_t *new_table = (tag_table_t *)tag_pool_get(&table_pool);
+  if (unlikely(new_table == NULL)) {
+    LOG("Failed to allocate tag table!\n");
+    libdft_die();
+  }
+  std::fill(new_table->page, new_table->page + PAGETABLE_SZ, clean_page);
+  __atomic_add_fetch(&tag_stats.tables, 1, __ATOMIC_RELAXED);
+  tag_stats_bytes(sizeof(tag_table_t));
+  return new_table;
+}
+
+static inline void tag_table_free(tag_table_t *table) {
+  __atomic_sub_fetch(&tag_stats.tables, 1, __ATOMIC_RELAXED);
+  tag_stats_bytes(-(INT64)sizeof(tag_table_t));
+  tag_pool_put(&table_pool, table);
+}
+
+/*
+ * allocate a tag page for the tag index @idx; every tag is set to @tag
+ *
+ * pages only go back to the pool once they are clean, so a page
+ * of cleared tags needs no fill when zero reads as cleared
+ */
+static inline tag_page_t *tag_page_alloc(tag_t const &tag, ADDRINT idx) {
+  tag_page_t *new_page = (tag_page_t *)tag_pool_get(&page_pool);
+  if (unlikely(new_page == NULL)) {
+    LOG("Failed to allocate tag page!\n");
+    libdft_die();
+  }
+  tag_page_charge(new_page, tagmap_region_of(idx << LIBDFT_TAG_GRAN_BITS));
+  new_page->epoch = tagmap_epoch;
+  new_page->refs = 0;
+  if (likely(pool_zero_clean && tag_is_empty(tag)))
+    return new_page;
+  std::fill(new_page->tag, new_page->tag + PAGE_SIZE, tag);
+  new_page->nr_tainted = tag_is_empty(tag) ? 0 : PAGE_SIZE;
+  memset(new_page->line_tainted, tag_is_empty(tag) ? 0 : CACHE_LINE_SIZE,
+         sizeof(new_page->line_tainted));
+  return new_page;
+}
+
+/*
+ * clear the tags of @page before it goes back to the pool; only
+ * the cache lines that hold taint are touched
+ */
+static inline void tag_page_reset(tag_page_t *page) {
+  if (page->nr_tainted == 0)
     return;
+  for (size_t line = 0; line < PAGE_LINES; line++) {
+    if (page->line_tainted[line] == 0)
+      continue;
+    std::fill(page->tag + (line << CACHE_LINE_BITS),
+              page->tag + ((line + 1) << CACHE_LINE_BITS),
+              tag_traits<tag_t>::cleared_val);
+    page->line_tainted[line] = 0;
   }
-  // LOG("Setting tag "+hexstr(addr)+"\n");
-  if (dir.table[VIRT2PAGETABLE(addr)] == NULL) {
-    //  LOG("No tag table for "+hexstr(addr)+" allocating new table\n");
-#ifndef _WIN32
-    tag_table_t *new_table = new (std::nothrow) tag_table_t();
-#else // _WIN32
-    tag_table_t *new_table = new tag_table_t();
-#endif
-    if (new_table == NULL) {
-      LOG("Failed to allocate tag table!\n");
-      libdft_die();
+  page->nr_tainted = 0;
+}
+
+/*
+ * get a reference to the uniform page of @tag; a new one is charged
+ * to tag index @idx
+ *
+ * returns: the page, or NULL if the uniform table is full
+ */
+static inline tag_page_t *tag_uniform_get(tag_t const &tag, ADDRINT idx) {
+  tag_page_t *page = NULL;
+  PIN_MutexLock(&uniform_lock);
+  std::map<tag_t, tag_page_t *>::iterator it = uniform_pages.find(tag);
+  if (it != uniform_pages.end()) {
+    page = it->second;
+    page->refs++;
+  } else if (uniform_pages.size() < UNIFORM_MAX) {
+    page = tag_page_alloc(tag, idx);
+    page->refs = 1;
+    uniform_pages[tag] = page;
+  }
+  PIN_MutexUnlock(&uniform_lock);
+  return page;
+}
+
+/*
+ * drop a reference to @page; a private page goes back to the pool,
+ * a uniform one once it is no longer shared (and, as with reclaimed
+ * pages, only while the application is single-threaded)
+ */
+static inline void tag_page_put(tag_page_t *page) {
+  if (page->refs) {
+    PIN_MutexLock(&uniform_lock);
+    if (--page->refs > 0 ||
+        __atomic_load_n(&tagmap_threaded, __ATOMIC_RELAXED)) {
+      PIN_MutexUnlock(&uniform_lock);
+      return;
     }
-    dir.table[VIRT2PAGETABLE(addr)] = new_table;
+    /* after tagmap_map_tags(), two uniform pages may share a tag */
+    std::map<tag_t, tag_page_t *>::iterator it =
+        uniform_pages.find(page->tag[0]);
+    if (it != uniform_pages.end() && it->second == page)
+      uniform_pages.erase(it);
+    PIN_MutexUnlock(&uniform_lock);
   }
+  tag_page_uncharge(page);
+  tag_page_reset(page);
+  tag_pool_put(&page_pool, page);
+}
 
-  tag_table_t *table = dir.table[VIRT2PAGETABLE(addr)];
-  if ((*table).page[VIRT2PAGE(addr)] == NULL) {
-    //    LOG("No tag page for "+hexstr(addr)+" allocating new page\n");
-#ifndef _WIN32
-    tag_page_t *new_page = new (std::nothrow) tag_page_t();
-#else // _WIN32
-    tag_page_t *new_page = new tag_page_t();
-#endif
-    if (new_page == NULL) {
+/*
+ * release @page, which @slot no longer holds; while a snapshot is
+ * active, pages it may refer to are kept in the undo log instead
+ */
+static inline void tag_page_release(tag_page_t **slot, tag_page_t *page) {
+  if (unlikely(snap_active && (page->refs || page->epoch != tagmap_epoch))) {
+    PIN_MutexLock(&journal_lock);
+    tag_undo_add(slot, page);
+    PIN_MutexUnlock(&journal_lock);
+    return;
+  }
+  tag_page_put(page);
+}
+
+/*
+ * install @page in @slot, unless another thread installed one first;
+ * in that case @page is released
+ *
+ * returns: the page that @slot holds
+ */
+static inline tag_page_t *tag_slot_install(tag_page_t **slot,
+                                           tag_page_t *page) {
+  tag_page_t *cur = CLEAN_SLOT;
+  if (likely(__atomic_compare_exchange_n(slot, &cur, page, false,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))) {
+    __atomic_add_fetch(&tagmap_gen, 1, __ATOMIC_RELEASE);
+    tag_journal_add(slot);
+    return page;
+  }
+  /* lost the race; optimized branch */
+  tag_page_put(page);
+  return cur;
+}
+
+/*
+ * release @page and reset @slot to the clean page; once the
+ * application is multithreaded, it is a no-op for private pages. A
+ * uniform page can always go, since only its reference is dropped
+ * then; the page itself stays for threads that may still read it
+ *
+ * returns: true if @page was released
+ */
+static inline bool tag_page_free(tag_page_t **slot, tag_page_t *page) {
+  if (page->refs == 0 && __atomic_load_n(&tagmap_threaded, __ATOMIC_RELAXED))
+    return false;
+  if (!__atomic_compare_exchange_n(slot, &page, CLEAN_SLOT, false,
+                                   __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+    return false;
+  __atomic_add_fetch(&tagmap_gen, 1, __ATOMIC_RELEASE);
+  tag_page_release(slot, page);
+  return true;
+}
+
+/*
+ * make @slot, which holds tag index @idx, share the uniform page of @tag
+ *
+ * returns: true on success, false if the uniform table is full
+ */
+static inline bool tag_slot_setuniform(tag_page_t **slot, ADDRINT idx,
+                                       tag_t const &tag) {
+  tag_page_t *uni = tag_uniform_get(tag, idx);
+  if (unlikely(uni == NULL))
+    return false;
+  tag_page_t *cur = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+  do {
+    if (cur == uni) {
+      tag_page_put(uni);
+      return true;
+    }
+  } while (!__atomic_compare_exchange_n(slot, &cur, uni, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+  __atomic_add_fetch(&tagmap_gen, 1, __ATOMIC_RELEASE);
+  if (cur == CLEAN_SLOT)
+    tag_journal_add(slot);
+  else
+    tag_page_release(slot, cur);
+  return true;
+}
+
+/*
+ * replace @page, which is either a uniform page or belongs to the
+ * snapshot, with a private copy that can be written; @idx is a tag
+ * index that @slot holds
+ *
+ * returns: the page that @slot holds
+ */
+static inline tag_page_t *tag_page_cow(tag_page_t **slot, tag_page_t *page,
+                                       ADDRINT idx) {
+  tag_page_t *copy;
+  if (page->refs) {
+    /* expand a uniform page */
+    copy = tag_page_alloc(page->tag[0], idx);
+  } else {
+    copy = (tag_page_t *)tag_pool_get(&page_pool);
+    if (unlikely(copy == NULL)) {
       LOG("Failed to allocate tag page!\n");
       libdft_die();
     }
-    std::fill(new_page->tag, new_page->tag + PAGE_SIZE,
-              tag_traits<tag_t>::cleared_val);
-    (*table).page[VIRT2PAGE(addr)] = new_page;
+    memcpy(copy, page, sizeof(tag_page_t));
+    tag_page_charge(copy, page->region);
+    copy->epoch = tagmap_epoch;
   }
+  tag_page_t *cur = page;
+  if (unlikely(!__atomic_compare_exchange_n(slot, &cur, copy, false,
+                                            __ATOMIC_ACQ_REL,
+                                            __ATOMIC_ACQUIRE))) {
+    /* another thread copied it first */
+    tag_page_put(copy);
+    return cur;
+  }
+  __atomic_add_fetch(&tagmap_gen, 1, __ATOMIC_RELEASE);
+  tag_page_release(slot, page);
+  return copy;
+}
 
-  tag_page_t *page = (*table).page[VIRT2PAGE(addr)];
-  (*page).tag[VIRT2OFFSET(addr)] = tag;
+#if LIBDFT_TAGMAP == libdft_tagmap_pagetable
+/*
+ * return the tag table that holds @addr, allocating it if needed
+ */
+static inline tag_table_t *tag_dir_gettable(tag_dir_t &dir, ADDRINT addr) {
+  tag_table_t **entry = &dir.table[VIRT2PAGETABLE(addr)];
+  tag_table_t *table = __atomic_load_n(entry, __ATOMIC_ACQUIRE);
+  if (table == NULL) {
+    //  LOG("No tag table for "+hexstr(addr)+" allocating new table\n");
+    tag_table_t *new_table = tag_table_alloc();
+    if (__atomic_compare_exchange_n(entry, &table, new_table, false,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+      return new_table;
+    /* another thread installed it first */
+    tag_table_free(new_table);
+  }
+  return table;
+}
+
+/*
+ * return the page slot that holds @addr; a missing tag table is
+ * allocated only if @alloc is set, otherwise NULL is returned
+ */
+static inline tag_page_t **tag_dir_getslot(tag_dir_t &dir, ADDRINT addr,
+                                           bool alloc) {
+  tag_table_t *table =
+      __atomic_load_n(&dir.table[VIRT2PAGETABLE(addr)], __ATOMIC_ACQUIRE);
+  if (table == NULL) {
+    if (!alloc)
+      return NULL;
+    table = tag_dir_gettable(dir, addr);
+  }
+  return &(*table).page[VIRT2PAGE(addr)];
+}
+#else
+static inline tag_page_t **tag_dir_getslot(ADDRINT addr, bool alloc) {
+  return &tag_map[addr >> PAGE_BITS];
+}
+#endif
+
+/*
+ * the page slot of @addr, regardless of the backend
+ */
+#if LIBDFT_TAGMAP == libdft_tagmap_pagetable
+#define TAG_SLOT(addr, alloc) tag_dir_getslot(*tag_dir, (addr), (alloc))
+#else
+#define TAG_SLOT(addr, alloc) tag_dir_getslot((addr), (alloc))
+#endif
+
+static inline void tag_dir_setb(ADDRINT addr, tag_t const &tag) {
+  if (addr > TAG_IDX_MAX) {
+    return;
+  }
+  // LOG("Setting tag "+hexstr(addr)+"\n");
+  /* clearing an untracked byte; optimized branch */
+  tag_page_t **slot = TAG_SLOT(addr, !tag_is_empty(tag));
+  if (slot == NULL)
+    return;
+
+  tag_page_t *page = SLOT2PAGE(__atomic_load_n(slot, __ATOMIC_ACQUIRE));
+  if ((*page).tag[VIRT2OFFSET(addr)] == tag)
+    return;
+
+  if (page == clean_page) {
+    //    LOG("No tag page for "+hexstr(addr)+" allocating new page\n");
+    page = tag_slot_install(
+        slot, tag_page_alloc(tag_traits<tag_t>::cleared_val, addr));
+  }
+  /* a shared page, or copy-on-write after a snapshot; optimized branch */
+  if (unlikely(page->refs || page->epoch != tagmap_epoch))
+    page = tag_page_cow(slot, page, addr);
+
+  /* swap the tag, so that racing writers agree on the summaries */
+  tag_t const old =
+      __atomic_exchange_n(&(*page).tag[VIRT2OFFSET(addr)], tag, __ATOMIC_RELAXED);
+  if (tag_is_empty(old) && !tag_is_empty(tag)) {
+    __atomic_add_fetch(&page->line_tainted[VIRT2LINE(addr)], 1,
+                       __ATOMIC_RELAXED);
+    __atomic_add_fetch(&page->nr_tainted, 1, __ATOMIC_RELAXED);
+  } else if (!tag_is_empty(old) && tag_is_empty(tag)) {
+    __atomic_sub_fetch(&page->line_tainted[VIRT2LINE(addr)], 1,
+                       __ATOMIC_RELAXED);
+    /* the last tainted byte of the page is gone */
+    if (__atomic_sub_fetch(&page->nr_tainted, 1, __ATOMIC_RELAXED) == 0)
+      tag_page_free(slot, page);
+  }
   /*
   if (!tag_is_empty(tag)) {
     LOGD("[!]Writing tag for %p \n", (void *)addr);
@@ -91,72 +560,1044 @@ inline void tag_dir_setb(tag_dir_t &dir, ADDRINT addr, tag_t const &tag) {
   */
 }
 
-inline tag_t const *tag_dir_getb_as_ptr(tag_dir_t const &dir, ADDRINT addr) {
-  if (addr > 0x7fffffffffff) {
-    return NULL;
+/*
+ * add @delta to the tainted-byte counters of cache line @line of @page
+ */
+static inline void tag_page_account(tag_page_t *page, size_t line,
+                                    ptrdiff_t delta) {
+  if (delta > 0) {
+    __atomic_add_fetch(&page->line_tainted[line], delta, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&page->nr_tainted, delta, __ATOMIC_RELAXED);
+  } else if (delta < 0) {
+    __atomic_sub_fetch(&page->line_tainted[line], -delta, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&page->nr_tainted, -delta, __ATOMIC_RELAXED);
+  }
+}
+
+/*
+ * set the tags of [addr, addr + n) to @tag; the range must not
+ * cross a page boundary
+ *
+ * clearing an untainted page is a no-op, and a page that ends up
+ * with no tainted byte is released instead of being filled
+ */
+static inline void tag_dir_setpage(ADDRINT addr, size_t n, tag_t const &tag) {
+  tag_t const cleared = tag_traits<tag_t>::cleared_val;
+  tag_page_t **slot = TAG_SLOT(addr, !tag_is_empty(tag));
+  if (slot == NULL)
+    return;
+
+  tag_page_t *page = SLOT2PAGE(__atomic_load_n(slot, __ATOMIC_ACQUIRE));
+  /* nothing changes; e.g., a partial fill of a uniform page */
+  if (page->refs && page->tag[0] == tag)
+    return;
+  if (n == PAGE_SIZE && !tag_is_empty(tag)) {
+    /*
+     * fully covered; share the uniform page of @tag, unless a private
+     * page would have to be released while other threads may use it
+     */
+    if ((page == clean_page || page->refs ||
+         !__atomic_load_n(&tagmap_threaded, __ATOMIC_RELAXED)) &&
+        tag_slot_setuniform(slot, addr, tag))
+      return;
   }
-  if (dir.table[VIRT2PAGETABLE(addr)]) {
-    tag_table_t *table = dir.table[VIRT2PAGETABLE(addr)];
-    if ((*table).page[VIRT2PAGE(addr)]) {
-      tag_page_t *page = (*table).page[VIRT2PAGE(addr)];
-      if (page != NULL)
-        return &(*page).tag[VIRT2OFFSET(addr)];
+  if (page == clean_page) {
+    if (tag_is_empty(tag))
+      return;
+    if (n == PAGE_SIZE) {
+      /* the new page is born with its final tags */
+      tag_page_t *new_page = tag_page_alloc(tag, addr);
+      page = tag_slot_install(slot, new_page);
+      if (page == new_page)
+        return;
+    } else {
+      page = tag_slot_install(slot, tag_page_alloc(cleared, addr));
     }
   }
-  return &tag_traits<tag_t>::cleared_val;
+
+  if (n == PAGE_SIZE && tag_is_empty(tag) && tag_page_free(slot, page))
+    return;
+  /* a shared page, or copy-on-write after a snapshot; optimized branch */
+  if (unlikely(page->refs || page->epoch != tagmap_epoch))
+    page = tag_page_cow(slot, page, addr);
+
+  /* fill one cache line at a time, keeping the summaries in sync */
+  size_t off = VIRT2OFFSET(addr);
+  size_t const end = off + n;
+  while (off < end) {
+    size_t const line = off >> CACHE_LINE_BITS;
+    size_t const stop = std::min(end, (line + 1) << CACHE_LINE_BITS);
+    size_t const tainted =
+        (stop - off) - tag_count_cleared(page->tag + off, stop - off);
+    std::fill(page->tag + off, page->tag + stop, tag);
+    tag_page_account(page, line,
+                     tag_is_empty(tag) ? -(ptrdiff_t)tainted
+                                       : (ptrdiff_t)((stop - off) - tainted));
+    off = stop;
+  }
+
+  if (__atomic_load_n(&page->nr_tainted, __ATOMIC_RELAXED) == 0)
+    tag_page_free(slot, page);
 }
 
-// PIN_FAST_ANALYSIS_CALL
-void tagmap_setb(ADDRINT addr, tag_t const &tag) {
-  tag_dir_setb(tag_dir, addr, tag);
+/*
+ * set the tags of [addr, addr + n) to @tag, one page at a time
+ */
+static inline void tag_dir_setn(ADDRINT addr, size_t n, tag_t const &tag) {
+  if (addr > TAG_IDX_MAX)
+    return;
+  /* clamp the range to the user address space */
+  if (n > TAG_IDX_MAX + 1 - addr)
+    n = TAG_IDX_MAX + 1 - addr;
+
+  while (n > 0) {
+    size_t chunk = PAGE_SIZE - VIRT2OFFSET(addr);
+    if (chunk > n)
+      chunk = n;
+    tag_dir_setpage(addr, chunk, tag);
+    addr += chunk;
+    n -= chunk;
+  }
 }
 
-void tagmap_setb_reg(THREADID tid, unsigned int reg_idx, unsigned int off,
-                     tag_t const &tag) {
-  threads_ctx[tid].vcpu.gpr[reg_idx][off] = tag;
+/*
+ * copy the @n tags at @tags to [addr, addr + n); the range must not
+ * cross a page boundary
+ */
+static inline void tag_dir_copypage(ADDRINT addr, size_t n,
+                                    tag_t const *tags) {
+  size_t const off = VIRT2OFFSET(addr);
+  bool const set = (tag_count_cleared(tags, n) != n);
+  tag_page_t **slot = TAG_SLOT(addr, set);
+  if (slot == NULL)
+    return;
+
+  tag_page_t *page = SLOT2PAGE(__atomic_load_n(slot, __ATOMIC_ACQUIRE));
+  /* nothing changes, e.g., untainted data moved around */
+  if (std::equal(tags, tags + n, page->tag + off))
+    return;
+  if (page == clean_page)
+    page = tag_slot_install(
+        slot, tag_page_alloc(tag_traits<tag_t>::cleared_val, addr));
+  /* a shared page, or copy-on-write after a snapshot; optimized branch */
+  if (unlikely(page->refs || page->epoch != tagmap_epoch))
+    page = tag_page_cow(slot, page, addr);
+
+  /* swap the tags as tag_dir_setb() does, one line of summaries at a time */
+  size_t line = off >> CACHE_LINE_BITS;
+  ptrdiff_t delta = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (((off + i) >> CACHE_LINE_BITS) != line) {
+      tag_page_account(page, line, delta);
+      line = (off + i) >> CACHE_LINE_BITS;
+      delta = 0;
+    }
+    tag_t const old =
+        __atomic_exchange_n(&page->tag[off + i], tags[i], __ATOMIC_RELAXED);
+    delta += (ptrdiff_t)tag_is_empty(old) - (ptrdiff_t)tag_is_empty(tags[i]);
+  }
+  tag_page_account(page, line, delta);
+
+  if (!set && __atomic_load_n(&page->nr_tainted, __ATOMIC_RELAXED) == 0)
+    tag_page_free(slot, page);
 }
 
-tag_t tagmap_getb(ADDRINT addr) { return *tag_dir_getb_as_ptr(tag_dir, addr); }
+#if LIBDFT_TAG_GRAN_BITS
+/*
+ * add @tag to the tag at index @addr
+ */
+static inline void tag_dir_mergeb(ADDRINT addr, tag_t const &tag);
+#endif
 
-tag_t tagmap_getb_reg(THREADID tid, unsigned int reg_idx, unsigned int off) {
-  return threads_ctx[tid].vcpu.gpr[reg_idx][off];
+/*
+ * set the tags of the application bytes [addr, addr + n) to @tag
+ *
+ * with coarse tags, only a granule that is written entirely gets
+ * @tag; one that is partly written merges @tag into its tag, and
+ * keeps it if @tag is cleared, since its other bytes may be tainted
+ */
+static inline void tag_dir_setn_bytes(ADDRINT addr, size_t n,
+                                      tag_t const &tag) {
+#if LIBDFT_TAG_GRAN_BITS
+  if (n == 0 || addr > VIRT_ADDR_MAX)
+    return;
+  if (n > VIRT_ADDR_MAX + 1 - addr)
+    n = VIRT_ADDR_MAX + 1 - addr;
+  /* the granules touched, and those covered entirely: [first, last) */
+  ADDRINT const lo = VIRT2TAG(addr);
+  ADDRINT const hi = VIRT2TAG(addr + n - 1);
+  ADDRINT const first = VIRT2TAG(addr + TAG_GRAN - 1);
+  ADDRINT const last = VIRT2TAG(addr + n);
+  if (lo < first || lo >= last)
+    tag_dir_mergeb(lo, tag);
+  if (hi != lo && hi >= last)
+    tag_dir_mergeb(hi, tag);
+  if (first < last)
+    tag_dir_setn(first, last - first, tag);
+#else
+  tag_dir_setn(addr, n, tag);
+#endif
 }
 
-tag_t tagmap_getw(ADDRINT addr) { return tagmap_getn(addr, sizeof(uint16_t)); }
+static inline tag_t const *tag_dir_getb_as_ptr(ADDRINT addr) {
+  return &tagmap_t::getpage(addr)->tag[VIRT2OFFSET(addr)];
+}
 
-tag_t tagmap_getl(ADDRINT addr) { return tagmap_getn(addr, sizeof(uint32_t)); }
+#if LIBDFT_TAG_GRAN_BITS
+static inline void tag_dir_mergeb(ADDRINT addr, tag_t const &tag) {
+  if (tag_is_empty(tag) || addr > TAG_IDX_MAX)
+    return;
+  tag_dir_setb(addr, tag_combine(*tag_dir_getb_as_ptr(addr), tag));
+}
+#endif
 
-void PIN_FAST_ANALYSIS_CALL tagmap_clrb(ADDRINT addr) {
-  tagmap_setb(addr, tag_traits<tag_t>::cleared_val);
+/*
+ * check whether any of the cache lines of @page that overlap
+ * [off, off + n) holds a tainted byte
+ */
+static inline bool tag_page_isset(tag_page_t const *page, size_t off,
+                                  size_t n) {
+  if (page == clean_page)
+    return false;
+  for (size_t line = off >> CACHE_LINE_BITS;
+       line <= (off + n - 1) >> CACHE_LINE_BITS; line++)
+    if (page->line_tainted[line])
+      return true;
+  return false;
 }
 
-void PIN_FAST_ANALYSIS_CALL tagmap_clrn(ADDRINT addr, UINT32 n) {
-  ADDRINT i;
-  for (i = addr; i < addr + n; i++) {
-    tagmap_clrb(i);
+/*
+ * set up the shared clean page (and, for the direct-mapped backend,
+ * reserve the page map); it must be called before any other
+ * tagmap function
+ *
+ * returns: 0 on success, 1 on error
+ */
+int tagmap_init(void) {
+#if LIBDFT_TAGMAP == libdft_tagmap_direct
+  /* address space only; nothing is committed until a slot is written */
+  void *m = mmap(NULL, TAG_MAP_SZ * sizeof(tag_page_t *),
+                 PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (unlikely(m == MAP_FAILED)) {
+    LOG("Failed to reserve the tag map!\n");
+    return 1;
+  }
+  tag_map = (tag_page_t **)m;
+#else
+#ifndef _WIN32
+  void *d = mmap(NULL, sizeof(tag_dir_t), PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (unlikely(d == MAP_FAILED)) {
+    LOG("Failed to reserve the tag directory!\n");
+    return 1;
+  }
+  tag_dir = (tag_dir_t *)d;
+#else  // _WIN32
+  tag_dir = new tag_dir_t();
+#endif
+#endif
+  if (unlikely(tag_pool_init(&page_pool, sizeof(tag_page_t)) ||
+               tag_pool_init(&table_pool, sizeof(tag_table_t)) ||
+               !PIN_MutexInit(&journal_lock) ||
+               !PIN_MutexInit(&uniform_lock) || tagmap_region_init())) {
+    LOG("Failed to set up the tag pools!\n");
+    return 1;
+  }
+  pool_zero_clean = (tag_traits<tag_t>::cleared_val == 0);
+  tag_simd_init();
+#ifndef _WIN32
+  size_t len = (sizeof(tag_page_t) + PAGE_SIZE - 1) & ~(size_t)OFFSET_MASK;
+  void *p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (unlikely(p == MAP_FAILED)) {
+    LOG("Failed to allocate the clean tag page!\n");
+    return 1;
+  }
+  clean_page = (tag_page_t *)p;
+#else  // _WIN32
+  clean_page = new tag_page_t();
+#endif
+  std::fill(clean_page->tag, clean_page->tag + PAGE_SIZE,
+            tag_traits<tag_t>::cleared_val);
+  clean_page->nr_tainted = 0;
+  memset(clean_page->line_tainted, 0, sizeof(clean_page->line_tainted));
+#ifndef _WIN32
+  /* any attempt to write through a stale slot faults */
+  (void)mprotect(p, len, PROT_READ);
+#endif
+  return 0;
+}
+
+/*
+ * log the chunk usage of the tag page and tag table pools
+ */
+void tagmap_pool_report(void) {
+  tag_pool_report(&page_pool, "tag pages");
+  tag_pool_report(&table_pool, "tag tables");
+}
+
+/*
+ * copy the shadow memory counters into @stats; the uniform pages are
+ * counted from their table
+ */
+void tagmap_stats(tagmap_stats_t *stats) {
+  UINT64 const *src = (UINT64 const *)&tag_stats;
+  UINT64 *dst = (UINT64 *)stats;
+  for (size_t i = 0; i < sizeof(tagmap_stats_t) / sizeof(UINT64); i++)
+    dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+
+  PIN_MutexLock(&uniform_lock);
+  stats->uniform_pages = uniform_pages.size();
+  stats->uniform_refs = 0;
+  for (std::map<tag_t, tag_page_t *>::const_iterator it =
+           uniform_pages.begin();
+       it != uniform_pages.end(); ++it)
+    stats->uniform_refs += it->second->refs;
+  PIN_MutexUnlock(&uniform_lock);
+}
+
+/*
+ * undo every slot change since the snapshot; pages written after it
+ * go back to the pool (journal_lock held)
+ */
+static void tag_snapshot_rollback(void) {
+  for (size_t i = undo_log.size(); i-- > 0;) {
+    tag_page_t **slot = undo_log[i].slot;
+    tag_page_t *cur = *slot;
+    /* the reference of the log passes to the slot */
+    if (cur != CLEAN_SLOT &&
+        (cur->refs || (cur != undo_log[i].page && cur->epoch == tagmap_epoch)))
+      tag_page_put(cur);
+    *slot = undo_log[i].page;
   }
+  undo_log.clear();
+  undo_compact_at = 1024;
+}
+
+/*
+ * forget the snapshot; the pages only it referenced go back to the
+ * pool, and its references to uniform pages are dropped (journal_lock
+ * held)
+ */
+static void tag_snapshot_drop(void) {
+  for (size_t i = 0; i < undo_log.size(); i++) {
+    tag_page_t *page = undo_log[i].page;
+    if (page != CLEAN_SLOT && (page->refs || *undo_log[i].slot != page))
+      tag_page_put(page);
+  }
+  undo_log.clear();
+  undo_compact_at = 1024;
+}
+
+/*
+ * checkpoint the taint state: the tagmap and the register tags of
+ * all threads
+ *
+ * no page is copied here; the pages that exist now are frozen and
+ * copied on their first write, so the cost is that of saving the
+ * register tags. A previous snapshot is dropped. As with
+ * tagmap_reset(), no thread may be running analysis code meanwhile.
+ */
+void tagmap_snapshot(void) {
+  PIN_MutexLock(&journal_lock);
+  tag_snapshot_drop();
+  tagmap_epoch++;
+  snap_active = true;
+  PIN_MutexUnlock(&journal_lock);
+
+  tagmap_vcpu_save();
+}
+
+/*
+ * roll the taint state back to the last snapshot, which stays in
+ * place for further restores; only the pages changed since then are
+ * touched
+ */
+void tagmap_restore(void) {
+  if (!snap_active)
+    return;
+  PIN_MutexLock(&journal_lock);
+  tag_snapshot_rollback();
+  PIN_MutexUnlock(&journal_lock);
+  __atomic_add_fetch(&tagmap_gen, 1, __ATOMIC_RELEASE);
+  tagmap_vcpu_restore();
+}
+
+/*
+ * drop all taint: every page in the journal goes back to the pool
+ * and the register tags of all threads are cleared; the cost is
+ * proportional to the pages written since the last reset
+ *
+ * no other thread may be running analysis code meanwhile (e.g., call
+ * it with the application threads stopped)
+ */
+void tagmap_reset(void) {
+  PIN_MutexLock(&journal_lock);
+  /* put the snapshot pages back, so that the journal covers them */
+  if (snap_active) {
+    tag_snapshot_rollback();
+    snap_active = false;
+  }
+  for (size_t i = 0; i < journal.size(); i++) {
+    tag_page_t **slot = journal[i];
+    tag_page_t *page = *slot;
+    /* reclaimed already, or a duplicate entry */
+    if (page == CLEAN_SLOT)
+      continue;
+    *slot = CLEAN_SLOT;
+    tag_page_put(page);
+  }
+  journal.clear();
+  journal_compact_at = 1024;
+  PIN_MutexUnlock(&journal_lock);
+  __atomic_add_fetch(&tagmap_gen, 1, __ATOMIC_RELEASE);
+  tagmap_vcpu_clear();
+}
+
+/*
+ * called when the application starts its second thread; tag pages
+ * are no longer reclaimed after that
+ */
+void tagmap_set_threaded(void) {
+  __atomic_store_n(&tagmap_threaded, true, __ATOMIC_SEQ_CST);
+}
+
+// PIN_FAST_ANALYSIS_CALL
+void tagmap_setb(ADDRINT addr, tag_t const &tag) {
+#if LIBDFT_TAG_GRAN_BITS
+  /* a byte is never a whole granule; its tag only adds taint */
+  tag_dir_mergeb(VIRT2TAG(addr), tag);
+#else
+  tag_dir_setb(addr, tag);
+#endif
+}
+
+void PIN_FAST_ANALYSIS_CALL tagmap_clrn(ADDRINT addr, UINT32 n) {
+  tag_dir_setn_bytes(addr, n, tag_traits<tag_t>::cleared_val);
 }
 
 void PIN_FAST_ANALYSIS_CALL tagmap_setn(ADDRINT addr, UINT32 n, tag_t const &tag) {
-  ADDRINT i;
-  for (i = addr; i < addr + n; i++) {
-    tagmap_setb(i, tag);
+  tag_dir_setn_bytes(addr, n, tag);
+}
+
+/*
+ * give back the page of @slot, which then reads as untainted
+ */
+static inline void tag_slot_drop(tag_page_t **slot) {
+  /* look first; most slots of a large range hold nothing */
+  if (__atomic_load_n(slot, __ATOMIC_RELAXED) == CLEAN_SLOT)
+    return;
+  tag_page_t *page = __atomic_exchange_n(slot, CLEAN_SLOT, __ATOMIC_ACQ_REL);
+  if (page == CLEAN_SLOT)
+    return;
+  __atomic_add_fetch(&tagmap_gen, 1, __ATOMIC_RELEASE);
+  tag_page_release(slot, page);
+}
+
+#if LIBDFT_TAGMAP == libdft_tagmap_pagetable
+/*
+ * free the tag table @tidx if none of its slots holds a page, and
+ * drop its slots from the journal; tables are kept while a snapshot
+ * is active, since the undo log may point into them
+ */
+static inline void tag_dir_droptable(ADDRINT tidx) {
+  tag_table_t *table =
+      __atomic_load_n(&tag_dir->table[tidx], __ATOMIC_ACQUIRE);
+  if (table == NULL)
+    return;
+  for (size_t i = 0; i < PAGETABLE_SZ; i++)
+    if (__atomic_load_n(&table->page[i], __ATOMIC_RELAXED) != CLEAN_SLOT)
+      return;
+
+  PIN_MutexLock(&journal_lock);
+  if (snap_active ||
+      !__atomic_compare_exchange_n(&tag_dir->table[tidx], &table,
+                                   (tag_table_t *)NULL, false,
+                                   __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+    PIN_MutexUnlock(&journal_lock);
+    return;
+  }
+  size_t j = 0;
+  for (size_t i = 0; i < journal.size(); i++)
+    if (journal[i] < table->page || journal[i] >= table->page + PAGETABLE_SZ)
+      journal[j++] = journal[i];
+  journal.resize(j);
+  PIN_MutexUnlock(&journal_lock);
+  tag_table_free(table);
+}
+#endif
+
+/*
+ * the application bytes [addr, addr + n) are gone (unmapped, or
+ * zero-filled by the kernel): clear their tags and give back the tag
+ * pages they cover entirely, along with the tag tables or the parts
+ * of the page map that end up empty
+ *
+ * once the application is multithreaded, the range may still be
+ * mapped (MADV_DONTNEED), and another thread may hold one of its
+ * pages in its page cache or be writing it; private pages are then
+ * only cleared, as with tagmap_clrn(), and tag tables and the page
+ * map are kept, so that no page is handed out for another address
+ * while a thread still uses it
+ */
+void tagmap_discard(ADDRINT addr, size_t n) {
+  tag_t const cleared = tag_traits<tag_t>::cleared_val;
+  if (n == 0 || addr > VIRT_ADDR_MAX)
+    return;
+  if (n > VIRT_ADDR_MAX + 1 - addr)
+    n = VIRT_ADDR_MAX + 1 - addr;
+
+  /* the tag pages, by tag index, that the range covers entirely */
+  ADDRINT const first = (VIRT2TAG(addr + TAG_GRAN - 1) + OFFSET_MASK) &
+                        ~(ADDRINT)OFFSET_MASK;
+  ADDRINT const last = VIRT2TAG(addr + n) & ~(ADDRINT)OFFSET_MASK;
+  if (first >= last) {
+    tag_dir_setn_bytes(addr, n, cleared);
+    return;
+  }
+  /* the partly covered pages at either end are only cleared */
+  ADDRINT const head = first << LIBDFT_TAG_GRAN_BITS;
+  ADDRINT const tail = last << LIBDFT_TAG_GRAN_BITS;
+  tag_dir_setn_bytes(addr, head - addr, cleared);
+  tag_dir_setn_bytes(tail, addr + n - tail, cleared);
+  bool const threaded = __atomic_load_n(&tagmap_threaded, __ATOMIC_RELAXED);
+
+#if LIBDFT_TAGMAP == libdft_tagmap_pagetable
+  for (ADDRINT idx = first; idx < last;) {
+    ADDRINT const tidx = VIRT2PAGETABLE(idx);
+    ADDRINT const base = tidx << PAGETABLE_BITS;
+    ADDRINT const next = std::min(last, base + (1UL << PAGETABLE_BITS));
+    tag_table_t *table =
+        __atomic_load_n(&tag_dir->table[tidx], __ATOMIC_ACQUIRE);
+    if (table != NULL) {
+      for (ADDRINT i = idx; i < next; i += PAGE_SIZE) {
+        if (threaded)
+          tag_dir_setpage(i, PAGE_SIZE, cleared);
+        else
+          tag_slot_drop(&table->page[VIRT2PAGE(i)]);
+      }
+      /* no byte the table covers is mapped any more */
+      if (!threaded && idx == base &&
+          next == base + (1UL << PAGETABLE_BITS))
+        tag_dir_droptable(tidx);
+    }
+    idx = next;
+  }
+#else
+  for (ADDRINT idx = first; idx < last; idx += PAGE_SIZE) {
+    if (threaded)
+      tag_dir_setpage(idx, PAGE_SIZE, cleared);
+    else
+      tag_slot_drop(&tag_map[idx >> PAGE_BITS]);
+  }
+  if (threaded)
+    return;
+#ifndef _WIN32
+  /* the parts of the page map that only cover the range go back to
+   * the kernel, and read as NULL slots again */
+  uintptr_t const lo =
+      ((uintptr_t)&tag_map[first >> PAGE_BITS] + OFFSET_MASK) &
+      ~(uintptr_t)OFFSET_MASK;
+  uintptr_t const hi =
+      (uintptr_t)&tag_map[last >> PAGE_BITS] & ~(uintptr_t)OFFSET_MASK;
+  if (lo < hi)
+    (void)madvise((void *)lo, hi - lo, MADV_DONTNEED);
+#endif
+#endif
+}
+
+/*
+ * copy the @n tags at @tags to the bytes [addr, addr + n); the tag
+ * page is resolved once for every page the range touches
+ */
+void tagmap_setn_tags(ADDRINT addr, unsigned int n, tag_t const *tags) {
+#if LIBDFT_TAG_GRAN_BITS
+  /*
+   * a granule gets the union of the tags of its bytes, as
+   * tag_dir_setn_bytes() sets it: replaced if written entirely,
+   * merged into otherwise
+   */
+  if (addr > VIRT_ADDR_MAX)
+    return;
+  if (n > VIRT_ADDR_MAX + 1 - addr)
+    n = VIRT_ADDR_MAX + 1 - addr;
+  while (n > 0) {
+    size_t const chunk =
+        std::min((size_t)n, TAG_GRAN - (size_t)(addr & TAG_GRAN_MASK));
+    tag_t const ts = tag_combine_n(tags, chunk, tag_traits<tag_t>::cleared_val);
+    if (chunk == TAG_GRAN)
+      tag_dir_setb(VIRT2TAG(addr), ts);
+    else
+      tag_dir_mergeb(VIRT2TAG(addr), ts);
+    tags += chunk;
+    addr += chunk;
+    n -= chunk;
+  }
+#else
+  if (addr > TAG_IDX_MAX)
+    return;
+  if (n > TAG_IDX_MAX + 1 - addr)
+    n = TAG_IDX_MAX + 1 - addr;
+  while (n > 0) {
+    size_t chunk = std::min((size_t)n, PAGE_SIZE - VIRT2OFFSET(addr));
+    tag_dir_copypage(addr, chunk, tags);
+    tags += chunk;
+    addr += chunk;
+    n -= chunk;
   }
+#endif
 }
 
+/*
+ * turn the application bytes [addr, addr + n) into the tag indices
+ * that cover them
+ */
+#if LIBDFT_TAG_GRAN_BITS
+#define TAG_SPAN(addr, n)                                                      \
+  do {                                                                         \
+    if ((n) > 0) {                                                             \
+      (n) = VIRT2TAG((addr) + (n)-1) - VIRT2TAG(addr) + 1;                     \
+      (addr) = VIRT2TAG(addr);                                                 \
+    }                                                                          \
+  } while (0)
+#else
+#define TAG_SPAN(addr, n)                                                      \
+  do {                                                                         \
+  } while (0)
+#endif
+
 tag_t tagmap_getn(ADDRINT addr, unsigned int n) {
   tag_t ts = tag_traits<tag_t>::cleared_val;
-  for (size_t i = 0; i < n; i++) {
-    const tag_t t = tagmap_getb(addr + i);
-    if (tag_is_empty(t))
-      continue;
-    // LOGD("[tagmap_getn] %lu, ts: %d, %s\n", i, ts, tag_sprint(t).c_str());
-    ts = tag_combine(ts, t);
-    // LOGD("t: %d, ts:%d\n", t, ts);
+  TAG_SPAN(addr, n);
+  while (n > 0) {
+    size_t chunk = std::min((size_t)n, PAGE_SIZE - VIRT2OFFSET(addr));
+    tag_page_t const *page = tagmap_t::getpage(addr);
+    if (page->refs) {
+      /* uniform page; all its tags are the same */
+      ts = tag_combine(ts, page->tag[0]);
+    } else if (unlikely(tag_page_isset(page, VIRT2OFFSET(addr), chunk))) {
+      /* an OR-reduce with byte tags */
+      ts = tag_combine_n(page->tag + VIRT2OFFSET(addr), chunk, ts);
+    }
+    addr += chunk;
+    n -= chunk;
   }
   return ts;
 }
 
+/*
+ * copy the tags of [addr, addr + n) into @tags
+ */
+void tagmap_getn_tags(ADDRINT addr, unsigned int n, tag_t *tags) {
+#if LIBDFT_TAG_GRAN_BITS
+  /* every byte gets the tag of its granule */
+  while (n > 0) {
+    size_t const chunk =
+        std::min((size_t)n, TAG_GRAN - (size_t)(addr & TAG_GRAN_MASK));
+    std::fill(tags, tags + chunk, *tag_dir_getb_as_ptr(VIRT2TAG(addr)));
+    tags += chunk;
+    addr += chunk;
+    n -= chunk;
+  }
+#else
+  while (n > 0) {
+    size_t chunk = std::min((size_t)n, PAGE_SIZE - VIRT2OFFSET(addr));
+    tag_page_t const *page = tagmap_t::getpage(addr);
+    if (likely(!tag_page_isset(page, VIRT2OFFSET(addr), chunk)))
+      std::fill(tags, tags + chunk, tag_traits<tag_t>::cleared_val);
+    else
+      std::copy(page->tag + VIRT2OFFSET(addr),
+                page->tag + VIRT2OFFSET(addr) + chunk, tags);
+    tags += chunk;
+    addr += chunk;
+    n -= chunk;
+  }
+#endif
+}
+
+/*
+ * check whether any byte of [addr, addr + n) is tainted
+ */
+bool tagmap_issetn(ADDRINT addr, unsigned int n) {
+  TAG_SPAN(addr, n);
+  while (n > 0) {
+    size_t chunk = std::min((size_t)n, PAGE_SIZE - VIRT2OFFSET(addr));
+    tag_page_t const *page = tagmap_t::getpage(addr);
+    if (page->refs)
+      return true;
+    if (tag_page_isset(page, VIRT2OFFSET(addr), chunk) &&
+        tag_count_cleared(page->tag + VIRT2OFFSET(addr), chunk) != chunk)
+      return true;
+    addr += chunk;
+    n -= chunk;
+  }
+  return false;
+}
+
+/*
+ * state of tagmap_walk(): the bytes asked for, and the interval that
+ * is being grown
+ */
+typedef struct {
+  ADDRINT start;
+  ADDRINT end;
+  tagmap_walk_cb cb;
+  void *arg;
+  tag_interval_t cur;
+  bool open;
+} tag_walk_t;
+
+/*
+ * hand the open interval of @w to its callback
+ *
+ * returns: false if the callback stopped the walk
+ */
+static inline bool tag_walk_flush(tag_walk_t *w) {
+  if (!w->open)
+    return true;
+  w->open = false;
+  return w->cb(&w->cur, w->arg);
+}
+
+/*
+ * add the tag indices [first, last), all tagged @tag, to the walk;
+ * they extend the open interval if they follow it with the same tag
+ *
+ * returns: false if the callback stopped the walk
+ */
+static inline bool tag_walk_add(tag_walk_t *w, ADDRINT first, ADDRINT last,
+                                tag_t const &tag) {
+  ADDRINT const start = std::max(w->start, first << LIBDFT_TAG_GRAN_BITS);
+  ADDRINT const end = std::min(w->end, last << LIBDFT_TAG_GRAN_BITS);
+  if (w->open && w->cur.end == start && w->cur.tag == tag) {
+    w->cur.end = end;
+    return true;
+  }
+  if (!tag_walk_flush(w))
+    return false;
+  w->cur.start = start;
+  w->cur.end = end;
+  w->cur.tag = tag;
+  w->open = true;
+  return true;
+}
+
+/*
+ * walk the tag indices [idx, last) one page at a time; clean pages
+ * and cache lines without taint are skipped on their summaries
+ */
+static bool tag_walk_pages(tag_walk_t *w, ADDRINT idx, ADDRINT last) {
+  while (idx < last) {
+    ADDRINT const base = idx & ~(ADDRINT)OFFSET_MASK;
+    size_t const stop = std::min(last - base, (ADDRINT)PAGE_SIZE);
+    tag_page_t const *page = tagmap_t::getpage(idx);
+    if (page->refs) {
+      if (!tag_walk_add(w, idx, base + stop, page->tag[0]))
+        return false;
+    } else if (page != clean_page) {
+      for (size_t i = VIRT2OFFSET(idx); i < stop;) {
+        size_t const line_end =
+            std::min(stop, ((i >> CACHE_LINE_BITS) + 1) << CACHE_LINE_BITS);
+        if (page->line_tainted[i >> CACHE_LINE_BITS] == 0) {
+          i = line_end;
+          continue;
+        }
+        tag_t const t = page->tag[i];
+        size_t j = i + 1;
+        while (j < line_end && page->tag[j] == t)
+          j++;
+        if (!tag_is_empty(t) && !tag_walk_add(w, base + i, base + j, t))
+          return false;
+        i = j;
+      }
+    }
+    idx = base + stop;
+  }
+  return true;
+}
+
+/*
+ * call @cb for every tainted interval of [start, end), in address
+ * order; adjacent bytes with the same tag are reported together.
+ * Tag tables that were never allocated are skipped whole.
+ *
+ * @cb must not change the tagmap; for a consistent view, the
+ * application threads should be stopped
+ *
+ * returns: false if @cb stopped the walk
+ */
+bool tagmap_walk(ADDRINT start, ADDRINT end, tagmap_walk_cb cb, void *arg) {
+  if (end > VIRT_ADDR_MAX + 1)
+    end = VIRT_ADDR_MAX + 1;
+  if (start >= end)
+    return true;
+  tag_walk_t w;
+  w.start = start;
+  w.end = end;
+  w.cb = cb;
+  w.arg = arg;
+  w.open = false;
+
+  /* the tag indices that cover the range */
+  ADDRINT idx = VIRT2TAG(start);
+  ADDRINT const last = VIRT2TAG(end - 1) + 1;
+#if LIBDFT_TAGMAP == libdft_tagmap_pagetable
+  while (idx < last) {
+    ADDRINT const next =
+        std::min(last, (VIRT2PAGETABLE(idx) + 1) << PAGETABLE_BITS);
+    if (__atomic_load_n(&tag_dir->table[VIRT2PAGETABLE(idx)],
+                        __ATOMIC_ACQUIRE) != NULL &&
+        !tag_walk_pages(&w, idx, next))
+      return false;
+    idx = next;
+  }
+#else
+  /*
+   * the page map has no summary of its own, but every slot that ever
+   * held a page since the last reset is in the journal; a range with
+   * more pages than that is walked through it
+   */
+  std::vector<ADDRINT> vpns;
+  PIN_MutexLock(&journal_lock);
+  bool const sparse =
+      ((last - idx + OFFSET_MASK) >> PAGE_BITS) > journal.size();
+  if (sparse) {
+    for (size_t i = 0; i < journal.size(); i++) {
+      ADDRINT const vpn = journal[i] - tag_map;
+      if (vpn >= (idx >> PAGE_BITS) && vpn <= ((last - 1) >> PAGE_BITS))
+        vpns.push_back(vpn);
+    }
+  }
+  PIN_MutexUnlock(&journal_lock);
+  if (!sparse) {
+    if (!tag_walk_pages(&w, idx, last))
+      return false;
+  } else {
+    std::sort(vpns.begin(), vpns.end());
+    vpns.erase(std::unique(vpns.begin(), vpns.end()), vpns.end());
+    for (size_t i = 0; i < vpns.size(); i++)
+      if (!tag_walk_pages(&w, std::max(idx, vpns[i] << PAGE_BITS),
+                          std::min(last, (vpns[i] + 1) << PAGE_BITS)))
+        return false;
+  }
+#endif
+  return tag_walk_flush(&w);
+}
+
+/*
+ * replace every tag in use (in the tag pages, those of the snapshot
+ * included, and in the register tags) with what @fn returns for it;
+ * cleared tags are skipped, and @fn must not return one for a
+ * tainted tag, so the summaries stay valid. Shared pages are mapped
+ * once.
+ *
+ * no other thread may be running analysis code meanwhile
+ */
+void tagmap_map_tags(tagmap_map_cb fn, void *arg) {
+  std::vector<tag_page_t *> pages;
+  PIN_MutexLock(&journal_lock);
+  for (size_t i = 0; i < journal.size(); i++)
+    if (*journal[i] != CLEAN_SLOT)
+      pages.push_back(*journal[i]);
+  for (size_t i = 0; i < undo_log.size(); i++)
+    if (undo_log[i].page != CLEAN_SLOT)
+      pages.push_back(undo_log[i].page);
+  PIN_MutexUnlock(&journal_lock);
+
+  PIN_MutexLock(&uniform_lock);
+  for (std::map<tag_t, tag_page_t *>::const_iterator it =
+           uniform_pages.begin();
+       it != uniform_pages.end(); ++it)
+    pages.push_back(it->second);
+  std::sort(pages.begin(), pages.end());
+  pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+  for (size_t i = 0; i < pages.size(); i++) {
+    tag_page_t *page = pages[i];
+    if (page->refs) {
+      std::fill(page->tag, page->tag + PAGE_SIZE, fn(page->tag[0], arg));
+      continue;
+    }
+    for (size_t line = 0; line < PAGE_LINES; line++) {
+      if (page->line_tainted[line] == 0)
+        continue;
+      for (size_t off = line << CACHE_LINE_BITS;
+           off < (line + 1) << CACHE_LINE_BITS; off++)
+        if (!tag_is_empty(page->tag[off]))
+          page->tag[off] = fn(page->tag[off], arg);
+    }
+  }
+  /* the uniform pages are keyed by their new tags */
+  std::map<tag_t, tag_page_t *> uniform;
+  for (std::map<tag_t, tag_page_t *>::const_iterator it =
+           uniform_pages.begin();
+       it != uniform_pages.end(); ++it)
+    uniform.insert(std::make_pair(it->second->tag[0], it->second));
+  uniform_pages.swap(uniform);
+  PIN_MutexUnlock(&uniform_lock);
+
+  tagmap_vcpu_map(fn, arg);
+}
+
+#endif /* LIBDFT_TAGMAP != libdft_tagmap_interval */
+
+/*
+ * address regions for the accounting, keyed by their first byte;
+ * they may be approximate (e.g., thread stacks), and addresses that
+ * fall in none of them count as mmap
+ */
+typedef struct {
+  ADDRINT end;
+  UINT32 region;
+} tag_region_t;
+static std::map<ADDRINT, tag_region_t> regions;
+static PIN_RWMUTEX region_lock;
+
+static const char *const region_names[TAG_REGION_NUM] = {"stack", "heap",
+                                                         "mmap", "image"};
+
+/*
+ * returns: 0 on success, 1 on error
+ */
+int tagmap_region_init(void) { return PIN_RWMutexInit(&region_lock) ? 0 : 1; }
+
+/*
+ * mark [start, end) as @region; a region that starts at @start is
+ * replaced (e.g., the heap growing)
+ */
+void tagmap_region_set(ADDRINT start, ADDRINT end, UINT32 region) {
+  tag_region_t const r = {end, region};
+  PIN_RWMutexWriteLock(&region_lock);
+  regions[start] = r;
+  PIN_RWMutexUnlock(&region_lock);
+}
+
+/*
+ * forget the region that starts at @start
+ */
+void tagmap_region_clear(ADDRINT start) {
+  PIN_RWMutexWriteLock(&region_lock);
+  regions.erase(start);
+  PIN_RWMutexUnlock(&region_lock);
+}
+
+/*
+ * returns: the TAG_REGION_* that @addr belongs to
+ */
+UINT32 tagmap_region_of(ADDRINT addr) {
+  UINT32 region = TAG_REGION_MMAP;
+  PIN_RWMutexReadLock(&region_lock);
+  std::map<ADDRINT, tag_region_t>::const_iterator it =
+      regions.upper_bound(addr);
+  if (it != regions.begin() && addr < (--it)->second.end)
+    region = it->second.region;
+  PIN_RWMutexUnlock(&region_lock);
+  return region;
+}
+
+/*
+ * log the shadow memory counters; called at exit, too
+ */
+void tagmap_stats_report(void) {
+  tagmap_stats_t st;
+  tagmap_stats(&st);
+  LOG("tagmap: " + decstr(st.bytes >> 10) + " KB in use, " +
+      decstr(st.bytes_peak >> 10) + " KB peak; " + decstr(st.tables) +
+      " tables, " + decstr(st.pages) + " pages (" + decstr(st.pages_peak) +
+      " peak, " + decstr(st.pages_reclaimed) + " reclaimed), " +
+      decstr(st.uniform_pages) + " uniform (" + decstr(st.uniform_refs) +
+      " references)\n");
+  for (size_t i = 0; i < TAG_REGION_NUM; i++)
+    LOG(std::string("tagmap: ") + region_names[i] + ": " +
+        decstr(st.region_pages[i]) + " pages (" + decstr(st.region_peak[i]) +
+        " peak)\n");
+}
+
+/*
+ * the register tags are kept the same way by every backend
+ */
+static std::vector<vcpu_ctx_t> snap_vcpu;
+
+/*
+ * clear the register tags of all threads
+ */
+void tagmap_vcpu_clear(void) {
+  for (size_t tid = 0; tid < tctx_ct; tid++) {
+    tag_t *gpr = &threads_ctx[tid].vcpu.gpr[0][0];
+    std::fill(gpr, gpr + (GRP_NUM + 1) * TAGS_PER_GPR,
+              tag_traits<tag_t>::cleared_val);
+  }
+}
+
+/*
+ * save the register tags of all threads for tagmap_vcpu_restore()
+ */
+void tagmap_vcpu_save(void) {
+  snap_vcpu.resize(tctx_ct);
+  for (size_t tid = 0; tid < tctx_ct; tid++)
+    snap_vcpu[tid] = threads_ctx[tid].vcpu;
+}
+
+/*
+ * restore the saved register tags; threads started after the save
+ * get clean registers
+ */
+void tagmap_vcpu_restore(void) {
+  for (size_t tid = 0; tid < tctx_ct; tid++) {
+    if (tid < snap_vcpu.size()) {
+      threads_ctx[tid].vcpu = snap_vcpu[tid];
+    } else {
+      tag_t *gpr = &threads_ctx[tid].vcpu.gpr[0][0];
+      std::fill(gpr, gpr + (GRP_NUM + 1) * TAGS_PER_GPR,
+                tag_traits<tag_t>::cleared_val);
+    }
+  }
+}
+
+/*
+ * tagmap_map_tags() for the register tags of all threads and the saved
+ * ones
+ */
+void tagmap_vcpu_map(tagmap_map_cb fn, void *arg) {
+  for (size_t tid = 0; tid < tctx_ct; tid++) {
+    tag_t *gpr = &threads_ctx[tid].vcpu.gpr[0][0];
+    for (size_t i = 0; i < (GRP_NUM + 1) * TAGS_PER_GPR; i++)
+      if (!tag_is_empty(gpr[i]))
+        gpr[i] = fn(gpr[i], arg);
+  }
+  for (size_t tid = 0; tid < snap_vcpu.size(); tid++) {
+    tag_t *gpr = &snap_vcpu[tid].gpr[0][0];
+    for (size_t i = 0; i < (GRP_NUM + 1) * TAGS_PER_GPR; i++)
+      if (!tag_is_empty(gpr[i]))
+        gpr[i] = fn(gpr[i], arg);
+  }
+}
+
+void tagmap_setb_reg(THREADID tid, unsigned int reg_idx, unsigned int off,
+                     tag_t const &tag) {
+  threads_ctx[tid].vcpu.gpr[reg_idx][off] = tag;
+}
+
+/*
+ * report the page cache counters of thread @tid
+ */
+void tagmap_cache_stats(THREADID tid, UINT64 *hits, UINT64 *misses) {
+  *hits = threads_ctx[tid].page_cache.hits;
+  *misses = threads_ctx[tid].page_cache.misses;
+}
+
+tag_t tagmap_getb_reg(THREADID tid, unsigned int reg_idx, unsigned int off) {
+  return threads_ctx[tid].vcpu.gpr[reg_idx][off];
+}
+
+tag_t tagmap_getw(ADDRINT addr) { return tagmap_getn(addr, sizeof(uint16_t)); }
+
+tag_t tagmap_getl(ADDRINT addr) { return tagmap_getn(addr, sizeof(uint32_t)); }
+
+void PIN_FAST_ANALYSIS_CALL tagmap_clrb(ADDRINT addr) {
+  tagmap_setb(addr, tag_traits<tag_t>::cleared_val);
+}
+
 tag_t tagmap_getn_reg(THREADID tid, unsigned int reg_idx, unsigned int n) {
   tag_t ts = tag_traits<tag_t>::cleared_val;
   for (size_t i = 0; i < n; i++) {
@@ -34,6 +34,7 @@
 #define __TAGMAP_H__
 
 #include "pin.H"
+#include "branch_pred.h"
 #include "tag_traits.h"
 #include <utility>
 
@@ -55,6 +56,52 @@
 #define VIRT2PAGE(addr) VIRT2PAGETABLE_OFFSET(addr)
 #define VIRT2OFFSET(addr) ((addr)&OFFSET_MASK)
 
+/*
+ * taint summaries are kept per cache line of the application
+ */
+#define CACHE_LINE_SIZE 64
+#define CACHE_LINE_BITS 6
+#define PAGE_LINES (PAGE_SIZE >> CACHE_LINE_BITS)
+#define VIRT2LINE(addr) (VIRT2OFFSET(addr) >> CACHE_LINE_BITS)
+
+/*
+ * tag granularity; every tag covers 2^LIBDFT_TAG_GRAN_BITS bytes of
+ * the application (e.g., 2 for 4, 6 for 64). The tagmap is indexed by
+ * VIRT2TAG(addr), so a coarser map is proportionally smaller.
+ */
+#ifndef LIBDFT_TAG_GRAN_BITS
+#define LIBDFT_TAG_GRAN_BITS 0
+#endif
+#define TAG_GRAN (1UL << LIBDFT_TAG_GRAN_BITS)
+#define TAG_GRAN_MASK (TAG_GRAN - 1)
+#define VIRT2TAG(addr) ((addr) >> LIBDFT_TAG_GRAN_BITS)
+
+/* highest user address that is tracked */
+#define VIRT_ADDR_MAX 0x7fffffffffffULL
+/* the paged backends work on tag indices, i.e. VIRT2TAG(addr) */
+#define TAG_IDX_MAX VIRT2TAG(VIRT_ADDR_MAX)
+
+/*
+ * the shadow store is picked at build time, much like the tag type:
+ * -DLIBDFT_TAGMAP=libdft_tagmap_direct, for instance
+ *
+ *   libdft_tagmap_pagetable  three-level page table (default)
+ *   libdft_tagmap_direct     flat array of page pointers, one per page
+ *                            of the user address space
+ *   libdft_tagmap_interval   tree of tag runs (tagmap_interval.cpp);
+ *                            range operations on few large buffers are
+ *                            cheap, but every tagmap_getb() takes a
+ *                            reader lock and walks the tree, about 20x
+ *                            slower than the page table for byte-at-a-
+ *                            time copies (tools/tagmap_bench.cpp)
+ */
+#define libdft_tagmap_pagetable 0
+#define libdft_tagmap_direct 1
+#define libdft_tagmap_interval 2
+#if !defined(LIBDFT_TAGMAP)
+#define LIBDFT_TAGMAP libdft_tagmap_pagetable
+#endif
+
 #define ALIGN_OFF_MAX 8 /* max alignment offset */
 #define ASSERT_FAST 32  /* used in comparisons  */
 
@@ -67,6 +114,11 @@ extern void libdft_die();
 /* For file taint */
 typedef struct {
   tag_t tag[PAGE_SIZE];
+  UINT32 nr_tainted;                /* number of non-cleared tags */
+  UINT32 epoch;                     /* snapshot epoch it was written in */
+  UINT32 refs;                      /* slots sharing it; 0 if private */
+  UINT32 region;                    /* TAG_REGION_* it is charged to */
+  UINT8 line_tainted[PAGE_LINES];   /* ditto, per cache line */
 } tag_page_t;
 typedef struct {
   tag_page_t *page[PAGETABLE_SZ];
@@ -75,17 +127,242 @@ typedef struct {
   tag_table_t *table[TOP_DIR_SZ];
 } tag_dir_t;
 
+/*
+ * per-thread cache of recently used tag pages; direct-mapped on
+ * the low bits of the virtual page number
+ */
+#ifndef LIBDFT_PAGE_CACHE_SZ
+#define LIBDFT_PAGE_CACHE_SZ 16 /* entries; must be a power of 2 */
+#endif
+typedef struct {
+  ADDRINT vpn[LIBDFT_PAGE_CACHE_SZ];           /* cached page numbers */
+  tag_page_t const *page[LIBDFT_PAGE_CACHE_SZ]; /* their tag pages */
+  UINT64 gen;    /* tagmap generation the entries are valid for */
+  UINT64 hits;   /* lookups served by the cache */
+  UINT64 misses; /* lookups that walked the tagmap */
+} page_cache_t;
+
+/*
+ * shadow memory accounting; a tag page is charged to the region of
+ * the address that first needed it
+ */
+enum {
+  TAG_REGION_STACK = 0,
+  TAG_REGION_HEAP,
+  TAG_REGION_MMAP, /* anything not known to be one of the others */
+  TAG_REGION_IMAGE,
+  TAG_REGION_NUM
+};
+
+typedef struct {
+  UINT64 tables;                       /* tag tables in use */
+  UINT64 pages;                        /* tag pages in use */
+  UINT64 pages_peak;                   /* high-water mark of the above */
+  UINT64 pages_reclaimed;              /* tag pages given back */
+  UINT64 bytes;                        /* shadow memory in use */
+  UINT64 bytes_peak;                   /* high-water mark of the above */
+  UINT64 region_pages[TAG_REGION_NUM]; /* tag pages in use, per region */
+  UINT64 region_peak[TAG_REGION_NUM];  /* ditto, high-water mark */
+  UINT64 uniform_pages;                /* shared pages of a single tag */
+  UINT64 uniform_refs;                 /* slots and snapshots using them */
+} tagmap_stats_t;
+
+/*
+ * a run of bytes with the same tag, as reported by tagmap_walk()
+ */
+typedef struct {
+  ADDRINT start; /* first byte */
+  ADDRINT end;   /* one past the last byte */
+  tag_t tag;     /* never the cleared value */
+} tag_interval_t;
+
+/* tagmap_walk() callback; returns false to stop the walk */
+typedef bool (*tagmap_walk_cb)(tag_interval_t const *iv, void *arg);
+
+/* tagmap_map_tags() callback; returns the tag to store instead of @tag */
+typedef tag_t (*tagmap_map_cb)(tag_t tag, void *arg);
+
+/* tagmap state read by the inline accessors; see tagmap.cpp */
+extern tag_dir_t *tag_dir;
+extern tag_page_t **tag_map;
+extern tag_page_t *clean_page;
+extern UINT64 tagmap_gen;
+
+/*
+ * the backends; each one provides getb() and getb_cached(), and the
+ * paged ones getpage() for the tag index @idx, which resolves
+ * untainted pages to clean_page. Only the one selected by
+ * LIBDFT_TAGMAP is used, so the analysis routines inline its
+ * accessors without any indirection.
+ */
+template <typename Store> struct tagmap_paged {
+  static inline tag_t getb(ADDRINT addr) {
+    ADDRINT const idx = VIRT2TAG(addr);
+    return Store::getpage(idx)->tag[VIRT2OFFSET(idx)];
+  }
+
+  /*
+   * getpage() that looks the tag page up in the page cache @pc first
+   */
+  static inline tag_page_t const *getpage_cached(page_cache_t *pc,
+                                                 ADDRINT idx) {
+    ADDRINT const vpn = idx >> PAGE_BITS;
+    size_t const slot = vpn & (LIBDFT_PAGE_CACHE_SZ - 1);
+
+    /* a page was allocated or freed since the last fill */
+    UINT64 const gen = __atomic_load_n(&tagmap_gen, __ATOMIC_ACQUIRE);
+    if (unlikely(pc->gen != gen)) {
+      for (size_t i = 0; i < LIBDFT_PAGE_CACHE_SZ; i++)
+        pc->vpn[i] = (ADDRINT)-1;
+      pc->gen = gen;
+    }
+
+    if (likely(pc->vpn[slot] == vpn)) {
+      pc->hits++;
+    } else {
+      pc->misses++;
+      pc->vpn[slot] = vpn;
+      pc->page[slot] = Store::getpage(idx);
+    }
+    return pc->page[slot];
+  }
+
+  /*
+   * getb() through the page cache @pc
+   */
+  static inline tag_t getb_cached(page_cache_t *pc, ADDRINT addr) {
+    ADDRINT const idx = VIRT2TAG(addr);
+    return getpage_cached(pc, idx)->tag[VIRT2OFFSET(idx)];
+  }
+
+  /*
+   * the tags of the @n bytes at @addr, in place in their tag page;
+   * NULL if the access crosses a page or bytes share tags
+   */
+  static inline tag_t const *span(page_cache_t *pc, ADDRINT addr,
+                                  unsigned int n) {
+#if LIBDFT_TAG_GRAN_BITS
+    return NULL;
+#else
+    if (unlikely(VIRT2OFFSET(addr) + n > PAGE_SIZE))
+      return NULL;
+    return &getpage_cached(pc, addr)->tag[VIRT2OFFSET(addr)];
+#endif
+  }
+};
+
+struct tagmap_pagetable : tagmap_paged<tagmap_pagetable> {
+  static inline tag_page_t const *getpage(ADDRINT idx) {
+    if (idx > TAG_IDX_MAX)
+      return clean_page;
+    tag_table_t *table = __atomic_load_n(&tag_dir->table[VIRT2PAGETABLE(idx)],
+                                         __ATOMIC_ACQUIRE);
+    if (table)
+      return __atomic_load_n(&(*table).page[VIRT2PAGE(idx)], __ATOMIC_ACQUIRE);
+    return clean_page;
+  }
+};
+
+struct tagmap_direct : tagmap_paged<tagmap_direct> {
+  static inline tag_page_t const *getpage(ADDRINT idx) {
+    if (idx > TAG_IDX_MAX)
+      return clean_page;
+    /* a single shift and load; a NULL slot is an untainted page */
+    tag_page_t const *page =
+        __atomic_load_n(&tag_map[idx >> PAGE_BITS], __ATOMIC_ACQUIRE);
+    return page ? page : clean_page;
+  }
+};
+
+struct tagmap_interval {
+  static tag_t getb(ADDRINT addr);
+  static tag_t getb_cached(page_cache_t *pc, ADDRINT addr);
+  /* the tags are not stored per byte */
+  static inline tag_t const *span(page_cache_t *pc, ADDRINT addr,
+                                  unsigned int n) {
+    return NULL;
+  }
+};
+
+#if LIBDFT_TAGMAP == libdft_tagmap_pagetable
+typedef tagmap_pagetable tagmap_t;
+#elif LIBDFT_TAGMAP == libdft_tagmap_direct
+typedef tagmap_direct tagmap_t;
+#elif LIBDFT_TAGMAP == libdft_tagmap_interval
+typedef tagmap_interval tagmap_t;
+#else
+#error "unknown LIBDFT_TAGMAP"
+#endif
+
+int tagmap_init(void);
+void tagmap_set_threaded(void);
+void tagmap_pool_report(void);
+void tagmap_region_set(ADDRINT start, ADDRINT end, UINT32 region);
+void tagmap_region_clear(ADDRINT start);
+UINT32 tagmap_region_of(ADDRINT addr);
+void tagmap_stats(tagmap_stats_t *stats);
+void tagmap_stats_report(void);
+void tagmap_reset(void);
+void tagmap_snapshot(void);
+void tagmap_restore(void);
 void tagmap_setb(ADDRINT addr, tag_t const &tag);
 void tagmap_setb_reg(THREADID tid, unsigned int reg_idx, unsigned int off,
                      tag_t const &tag);
-tag_t tagmap_getb(ADDRINT addr);
+void tagmap_cache_stats(THREADID tid, UINT64 *hits, UINT64 *misses);
 tag_t tagmap_getb_reg(THREADID tid, unsigned int reg_idx, unsigned int off);
 tag_t tagmap_getw(ADDRINT addr);
 tag_t tagmap_getl(ADDRINT addr);
 tag_t tagmap_getn(ADDRINT addr, unsigned int size);
+void tagmap_getn_tags(ADDRINT addr, unsigned int n, tag_t *tags);
+void tagmap_setn_tags(ADDRINT addr, unsigned int n, tag_t const *tags);
+bool tagmap_issetn(ADDRINT addr, unsigned int n);
+bool tagmap_walk(ADDRINT start, ADDRINT end, tagmap_walk_cb cb, void *arg);
+void tagmap_map_tags(tagmap_map_cb fn, void *arg);
 tag_t tagmap_getn_reg(THREADID tid, unsigned int reg_idx, unsigned int n);
+int tagmap_region_init(void);
+void tagmap_vcpu_clear(void);
+void tagmap_vcpu_save(void);
+void tagmap_vcpu_restore(void);
+void tagmap_vcpu_map(tagmap_map_cb fn, void *arg);
 void tagmap_clrb(ADDRINT addr);
 void tagmap_clrn(ADDRINT, UINT32);
+void tagmap_discard(ADDRINT addr, size_t n);
 void tagmap_setn(ADDRINT addr, UINT32 n, tag_t const &tag);
 
+inline tag_t tagmap_getb(ADDRINT addr) { return tagmap_t::getb(addr); }
+
+/*
+ * tagmap_getb() for analysis routines, which pass the page cache of
+ * their thread
+ */
+inline tag_t tagmap_getb_cached(page_cache_t *pc, ADDRINT addr) {
+  return tagmap_t::getb_cached(pc, addr);
+}
+
+/*
+ * the tags of the @n bytes at @addr for analysis routines: an access
+ * that stays within a tag page is served in place with a single page
+ * lookup, any other is copied into @buf, which holds @n tags
+ */
+inline tag_t const *tagmap_getn_span(page_cache_t *pc, ADDRINT addr,
+                                     unsigned int n, tag_t *buf) {
+  tag_t const *tags = tagmap_t::span(pc, addr, n);
+  if (likely(tags != NULL))
+    return tags;
+  tagmap_getn_tags(addr, n, buf);
+  return buf;
+}
+
+/*
+ * tagmap_getn_tags() through the page cache @pc
+ */
+inline void tagmap_getn_tags_cached(page_cache_t *pc, ADDRINT addr,
+                                    unsigned int n, tag_t *tags) {
+  tag_t const *span = tagmap_t::span(pc, addr, n);
+  if (likely(span != NULL))
+    std::copy(span, span + n, tags);
+  else
+    tagmap_getn_tags(addr, n, tags);
+}
+
 #endif /* __TAGMAP_H__ */
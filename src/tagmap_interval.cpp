@@ -0,0 +1,385 @@
+/*-
+ * Copyright (c) 2010, Columbia University
+ * All rights reserved.
+ *
+ * This software was developed by Vasileios P. Kemerlis <vpk@cs.columbia.edu>
+ * at Columbia University, New York, NY, USA, in June 2010.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Columbia University nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "tagmap.h"
+#include "branch_pred.h"
+#include "debug.h"
+#include "pin.H"
+#include <algorithm>
+#include <map>
+#include <string.h>
+#include <vector>
+
+/*
+ * interval tagmap (-DLIBDFT_TAGMAP=libdft_tagmap_interval)
+ *
+ * taint is kept as a balanced tree of disjoint [begin, end) runs of
+ * the same tag; untainted bytes have no run and adjacent runs with
+ * the same tag are merged. Setting, clearing or reading a range costs
+ * O(log runs) plus the runs it covers, so a few large buffers that
+ * are copied around take a handful of nodes instead of tag pages.
+ * Programs that taint many scattered bytes are better served by the
+ * page-table tagmap.
+ */
+#if LIBDFT_TAGMAP == libdft_tagmap_interval
+
+#if LIBDFT_TAG_GRAN_BITS
+#error "the interval tagmap is byte-granular"
+#endif
+
+typedef struct {
+  ADDRINT end; /* one past the last byte */
+  tag_t tag;   /* never the cleared value */
+} tag_run_t;
+
+typedef std::map<ADDRINT, tag_run_t> tag_runs_t;
+
+/* a tree node holds the key, the run and three links plus a color */
+#define RUN_NODE_SZ (sizeof(tag_runs_t::value_type) + 4 * sizeof(void *))
+
+/* runs keyed by their first byte */
+static tag_runs_t runs;
+/* guards runs; readers share it */
+static PIN_RWMUTEX runs_lock;
+/* high-water mark of runs.size() */
+static size_t runs_peak = 0;
+
+/* the runs at the last tagmap_snapshot() */
+static tag_runs_t snap_runs;
+static bool snap_active = false;
+
+/*
+ * make sure no run straddles @addr (runs_lock held for writing)
+ *
+ * returns: the first run that starts at or after @addr
+ */
+static inline tag_runs_t::iterator tag_run_split(ADDRINT addr) {
+  tag_runs_t::iterator it = runs.lower_bound(addr);
+  if (it == runs.begin())
+    return it;
+  tag_runs_t::iterator prev = it;
+  --prev;
+  if (prev->second.end <= addr)
+    return it;
+  /* cut the run in two */
+  tag_run_t tail = {prev->second.end, prev->second.tag};
+  prev->second.end = addr;
+  return runs.insert(it, std::make_pair(addr, tail));
+}
+
+/*
+ * set the tags of [addr, end) to @tag (runs_lock held for writing)
+ */
+static inline void tag_runs_set(ADDRINT addr, ADDRINT end, tag_t const &tag) {
+  /* map iterators survive the insertion done by the second split */
+  tag_runs_t::iterator first = tag_run_split(addr);
+  tag_runs_t::iterator it = tag_run_split(end);
+  runs.erase(first, it);
+  if (tag_is_empty(tag))
+    return;
+
+  ADDRINT begin = addr;
+  /* merge with the run that ends at addr */
+  if (it != runs.begin()) {
+    tag_runs_t::iterator prev = it;
+    --prev;
+    if (prev->second.end == addr && prev->second.tag == tag) {
+      begin = prev->first;
+      runs.erase(prev);
+    }
+  }
+  /* and with the one that starts at end */
+  if (it != runs.end() && it->first == end && it->second.tag == tag) {
+    end = it->second.end;
+    it = runs.erase(it);
+  }
+  tag_run_t run = {end, tag};
+  runs.insert(it, std::make_pair(begin, run));
+}
+
+/*
+ * the first run that overlaps [addr, ...) (runs_lock held)
+ */
+static inline tag_runs_t::const_iterator tag_runs_find(ADDRINT addr) {
+  tag_runs_t::const_iterator it = runs.upper_bound(addr);
+  if (it != runs.begin()) {
+    tag_runs_t::const_iterator prev = it;
+    --prev;
+    if (prev->second.end > addr)
+      return prev;
+  }
+  return it;
+}
+
+/*
+ * clamp [addr, addr + n) so that it does not wrap around
+ */
+static inline ADDRINT tag_range_end(ADDRINT addr, size_t n) {
+  return (addr + n < addr) ? (ADDRINT)-1 : addr + n;
+}
+
+int tagmap_init(void) {
+  if (unlikely(!PIN_RWMutexInit(&runs_lock) || tagmap_region_init())) {
+    LOG("Failed to set up the interval tagmap!\n");
+    return 1;
+  }
+  return 0;
+}
+
+/*
+ * the tree is locked in all cases, so nothing changes here
+ */
+void tagmap_set_threaded(void) {}
+
+/*
+ * log the number of runs and their approximate footprint
+ */
+void tagmap_pool_report(void) {
+  PIN_RWMutexReadLock(&runs_lock);
+  size_t const nr = runs.size();
+  PIN_RWMutexUnlock(&runs_lock);
+  LOG("tag runs: " + decstr(nr) + " (" + decstr((nr * RUN_NODE_SZ) >> 10) +
+      " KB)\n");
+}
+
+/*
+ * copy the shadow memory counters into @stats; there are no tag
+ * pages, so only the bytes are reported
+ */
+void tagmap_stats(tagmap_stats_t *stats) {
+  memset(stats, 0, sizeof(*stats));
+  PIN_RWMutexReadLock(&runs_lock);
+  stats->bytes = runs.size() * RUN_NODE_SZ;
+  stats->bytes_peak = runs_peak * RUN_NODE_SZ;
+  PIN_RWMutexUnlock(&runs_lock);
+}
+
+/*
+ * checkpoint the taint state; the runs are copied, so the cost is
+ * proportional to their number
+ */
+void tagmap_snapshot(void) {
+  PIN_RWMutexReadLock(&runs_lock);
+  snap_runs = runs;
+  PIN_RWMutexUnlock(&runs_lock);
+  snap_active = true;
+  tagmap_vcpu_save();
+}
+
+/*
+ * roll the taint state back to the last snapshot, which stays in
+ * place for further restores
+ */
+void tagmap_restore(void) {
+  if (!snap_active)
+    return;
+  PIN_RWMutexWriteLock(&runs_lock);
+  runs = snap_runs;
+  runs_peak = std::max(runs_peak, runs.size());
+  PIN_RWMutexUnlock(&runs_lock);
+  tagmap_vcpu_restore();
+}
+
+/*
+ * drop all taint, including any snapshot
+ */
+void tagmap_reset(void) {
+  PIN_RWMutexWriteLock(&runs_lock);
+  runs.clear();
+  snap_runs.clear();
+  snap_active = false;
+  PIN_RWMutexUnlock(&runs_lock);
+  tagmap_vcpu_clear();
+}
+
+void tagmap_setb(ADDRINT addr, tag_t const &tag) {
+  tagmap_setn(addr, 1, tag);
+}
+
+tag_t tagmap_interval::getb(ADDRINT addr) {
+  tag_t tag = tag_traits<tag_t>::cleared_val;
+  PIN_RWMutexReadLock(&runs_lock);
+  tag_runs_t::const_iterator it = tag_runs_find(addr);
+  if (it != runs.end() && it->first <= addr)
+    tag = it->second.tag;
+  PIN_RWMutexUnlock(&runs_lock);
+  return tag;
+}
+
+/*
+ * there are no tag pages to cache; every lookup is counted as a miss
+ */
+tag_t tagmap_interval::getb_cached(page_cache_t *pc, ADDRINT addr) {
+  pc->misses++;
+  return getb(addr);
+}
+
+void PIN_FAST_ANALYSIS_CALL tagmap_clrn(ADDRINT addr, UINT32 n) {
+  tagmap_setn(addr, n, tag_traits<tag_t>::cleared_val);
+}
+
+void PIN_FAST_ANALYSIS_CALL tagmap_setn(ADDRINT addr, UINT32 n, tag_t const &tag) {
+  if (n == 0)
+    return;
+  ADDRINT const end = tag_range_end(addr, n);
+  PIN_RWMutexWriteLock(&runs_lock);
+  tag_runs_set(addr, end, tag);
+  runs_peak = std::max(runs_peak, runs.size());
+  PIN_RWMutexUnlock(&runs_lock);
+}
+
+/*
+ * the bytes [addr, addr + n) are gone; erasing their runs frees the
+ * nodes
+ */
+void tagmap_discard(ADDRINT addr, size_t n) {
+  if (n == 0)
+    return;
+  ADDRINT const end = tag_range_end(addr, n);
+  PIN_RWMutexWriteLock(&runs_lock);
+  tag_runs_set(addr, end, tag_traits<tag_t>::cleared_val);
+  PIN_RWMutexUnlock(&runs_lock);
+}
+
+/*
+ * copy the @n tags at @tags to [addr, addr + n); bytes with the same
+ * tag are set as one run
+ */
+void tagmap_setn_tags(ADDRINT addr, unsigned int n, tag_t const *tags) {
+  size_t const len = tag_range_end(addr, n) - addr;
+  PIN_RWMutexWriteLock(&runs_lock);
+  for (size_t i = 0, j; i < len; i = j) {
+    for (j = i + 1; j < len && tags[j] == tags[i]; j++)
+      ;
+    tag_runs_set(addr + i, addr + j, tags[i]);
+  }
+  runs_peak = std::max(runs_peak, runs.size());
+  PIN_RWMutexUnlock(&runs_lock);
+}
+
+tag_t tagmap_getn(ADDRINT addr, unsigned int n) {
+  tag_t ts = tag_traits<tag_t>::cleared_val;
+  if (n == 0)
+    return ts;
+  ADDRINT const end = tag_range_end(addr, n);
+  PIN_RWMutexReadLock(&runs_lock);
+  for (tag_runs_t::const_iterator it = tag_runs_find(addr);
+       it != runs.end() && it->first < end; ++it)
+    ts = tag_combine(ts, it->second.tag);
+  PIN_RWMutexUnlock(&runs_lock);
+  return ts;
+}
+
+/*
+ * copy the tags of [addr, addr + n) into @tags
+ */
+void tagmap_getn_tags(ADDRINT addr, unsigned int n, tag_t *tags) {
+  ADDRINT const end = tag_range_end(addr, n);
+  std::fill(tags, tags + (end - addr), tag_traits<tag_t>::cleared_val);
+  PIN_RWMutexReadLock(&runs_lock);
+  for (tag_runs_t::const_iterator it = tag_runs_find(addr);
+       it != runs.end() && it->first < end; ++it)
+    std::fill(tags + (std::max(it->first, addr) - addr),
+              tags + (std::min(it->second.end, end) - addr), it->second.tag);
+  PIN_RWMutexUnlock(&runs_lock);
+}
+
+/*
+ * check whether any byte of [addr, addr + n) is tainted
+ */
+bool tagmap_issetn(ADDRINT addr, unsigned int n) {
+  if (n == 0)
+    return false;
+  ADDRINT const end = tag_range_end(addr, n);
+  PIN_RWMutexReadLock(&runs_lock);
+  tag_runs_t::const_iterator it = tag_runs_find(addr);
+  bool const set = (it != runs.end() && it->first < end);
+  PIN_RWMutexUnlock(&runs_lock);
+  return set;
+}
+
+/*
+ * call @cb for every tainted interval of [start, end), in address
+ * order; the runs are copied first, so @cb runs without the lock
+ *
+ * returns: false if @cb stopped the walk
+ */
+bool tagmap_walk(ADDRINT start, ADDRINT end, tagmap_walk_cb cb, void *arg) {
+  std::vector<tag_interval_t> ivs;
+  if (start >= end)
+    return true;
+  PIN_RWMutexReadLock(&runs_lock);
+  for (tag_runs_t::const_iterator it = tag_runs_find(start);
+       it != runs.end() && it->first < end; ++it) {
+    tag_interval_t const iv = {std::max(it->first, start),
+                               std::min(it->second.end, end), it->second.tag};
+    ivs.push_back(iv);
+  }
+  PIN_RWMutexUnlock(&runs_lock);
+  for (size_t i = 0; i < ivs.size(); i++)
+    if (!cb(&ivs[i], arg))
+      return false;
+  return true;
+}
+
+/*
+ * replace the tag of every run of @r with what @fn returns for it,
+ * merging the runs that end up alike (runs_lock held for writing)
+ */
+static void tag_runs_map(tag_runs_t &r, tagmap_map_cb fn, void *arg) {
+  tag_runs_t::iterator prev = r.end();
+  for (tag_runs_t::iterator it = r.begin(); it != r.end();) {
+    it->second.tag = fn(it->second.tag, arg);
+    if (prev != r.end() && prev->second.end == it->first &&
+        prev->second.tag == it->second.tag) {
+      prev->second.end = it->second.end;
+      r.erase(it++);
+      continue;
+    }
+    prev = it++;
+  }
+}
+
+/*
+ * replace every tag in use, those of the snapshot and the register
+ * tags included, with what @fn returns for it; @fn must not return the
+ * cleared tag
+ */
+void tagmap_map_tags(tagmap_map_cb fn, void *arg) {
+  PIN_RWMutexWriteLock(&runs_lock);
+  tag_runs_map(runs, fn, arg);
+  tag_runs_map(snap_runs, fn, arg);
+  PIN_RWMutexUnlock(&runs_lock);
+  tagmap_vcpu_map(fn, arg);
+}
+
+#endif /* LIBDFT_TAGMAP == libdft_tagmap_interval */
@@ -0,0 +1,132 @@
+#include "branch_pred.h"
+#include "libdft_api.h"
+#include "pin.H"
+#include <iostream>
+#include <stdio.h>
+#include <vector>
+
+// checks that BDDTag::collect() keeps what labels stand for, and that
+// combining the new labels gives the same sets as combining the old ones
+
+#define NR_LABELS 300
+#define NR_COMBINES 60000
+#define NR_PAIRS 5000
+#define NR_ROUNDS 8
+
+static std::vector<lb_type> roots_lb;
+static unsigned int seed = 1;
+static size_t fails = 0;
+
+static void roots(bdd_map_fn fn, void *arg) {
+  for (size_t i = 0; i < roots_lb.size(); i++)
+    roots_lb[i] = fn(roots_lb[i], arg);
+}
+
+static bool push_offs(tag_seg const *seg, void *arg) {
+  std::vector<tag_off> &offs = *static_cast<std::vector<tag_off> *>(arg);
+  for (tag_off i = seg->begin; i < seg->end; i++)
+    offs.push_back(i);
+  return true;
+}
+
+// labels for one set may differ; the offsets may not
+static std::vector<tag_off> offs_of(lb_type lb) {
+  std::vector<tag_off> offs;
+  tag_visit(lb, push_offs, &offs);
+  return offs;
+}
+
+static lb_type make(tag_off const *offs, size_t n) {
+  lb_type lb = 0;
+  for (size_t i = 0; i < n; i++)
+    lb = tag_combine(lb, tag_alloc<lb_type>(offs[i]));
+  return lb;
+}
+
+static void check(bool ok, const char *what) {
+  if (unlikely(!ok)) {
+    printf("[BDD GC] FAIL: %s\n", what);
+    fails++;
+  }
+}
+
+// two labels that share a start offset, but not an end
+static void test_adjacent(void) {
+  static tag_off const a[] = {2846, 2848, 2857, 2858, 2911};
+  static tag_off const b[] = {2801, 2847, 2857, 2924};
+  lb_type lb_b = make(b, sizeof(b) / sizeof(b[0]));
+  lb_type lb_a = make(a, sizeof(a) / sizeof(a[0]));
+  std::vector<tag_off> before = offs_of(tag_combine(lb_b, lb_a));
+
+  roots_lb.clear();
+  roots_lb.push_back(lb_b);
+  roots_lb.push_back(lb_a);
+  tag_collect<lb_type>(roots);
+  check(offs_of(tag_combine(roots_lb[0], roots_lb[1])) == before,
+        "adjacent segments");
+}
+
+static void test_random(tag_off range) {
+  std::vector<lb_type> lbs;
+  for (size_t i = 0; i < NR_LABELS; i++)
+    lbs.push_back(tag_alloc<lb_type>(rand_r(&seed) % range));
+  for (size_t i = 0; i < NR_COMBINES; i++) {
+    lb_type lb = tag_combine(lbs[rand_r(&seed) % NR_LABELS],
+                             lbs[rand_r(&seed) % NR_LABELS]);
+    lbs[rand_r(&seed) % NR_LABELS] = lb;
+  }
+
+  std::vector<std::vector<tag_off> > sets, unions;
+  std::vector<size_t> pairs;
+  for (size_t i = 0; i < NR_LABELS; i++)
+    sets.push_back(offs_of(lbs[i]));
+  for (size_t i = 0; i < NR_PAIRS; i++) {
+    size_t l = rand_r(&seed) % NR_LABELS, r = rand_r(&seed) % NR_LABELS;
+    pairs.push_back(l);
+    pairs.push_back(r);
+    unions.push_back(offs_of(tag_combine(lbs[l], lbs[r])));
+  }
+
+  roots_lb = lbs;
+  size_t reclaimed = tag_collect<lb_type>(roots);
+  lbs = roots_lb;
+  check(reclaimed > 0, "nothing reclaimed");
+  for (size_t i = 0; i < NR_LABELS; i++)
+    check(offs_of(lbs[i]) == sets[i], "label changed");
+  for (size_t i = 0; i < NR_PAIRS; i++)
+    check(offs_of(tag_combine(lbs[pairs[2 * i]], lbs[pairs[2 * i + 1]])) ==
+              unions[i],
+          "combine after collection");
+}
+
+VOID EntryPoint(VOID *v) {
+  test_adjacent();
+  for (size_t i = 0; i < NR_ROUNDS; i++)
+    test_random(i & 1 ? 4096 : 256);
+  printf("[BDD GC] %s (%lu failures)\n", fails ? "FAIL" : "OK", fails);
+  if (fails)
+    PIN_ExitProcess(1);
+}
+
+int main(int argc, char *argv[]) {
+
+  PIN_InitSymbols();
+
+  if (unlikely(PIN_Init(argc, argv))) {
+    std::cerr
+        << "Sth error in PIN_Init. Plz use the right command line options."
+        << std::endl;
+    return -1;
+  }
+
+  if (unlikely(libdft_init() != 0)) {
+    std::cerr << "Sth error libdft_init." << std::endl;
+    return -1;
+  }
+
+  PIN_AddApplicationStartFunction(EntryPoint, 0);
+
+  PIN_StartProgram();
+
+  return 0;
+}
@@ -0,0 +1,158 @@
+#include "branch_pred.h"
+#include "libdft_api.h"
+#include "pin.H"
+#include <bitset>
+#include <iostream>
+#include <stdio.h>
+#include <time.h>
+
+// hammers the shared BDDTag with inserts and combines from internal
+// threads, checks the results, and times the same work on 1, 2, 4, ...
+// threads to see how it scales
+
+#define MAX_OFF 256
+#define NR_MINE 64
+#define NR_SHARED 1024
+
+static KNOB<UINT32> nr_threads(KNOB_MODE_WRITEONCE, "pintool", "n", "8",
+                               "most threads to run");
+static KNOB<UINT32> nr_iters(KNOB_MODE_WRITEONCE, "pintool", "i", "2000000",
+                             "combines per round, split among the threads");
+static KNOB<BOOL> verify(KNOB_MODE_WRITEONCE, "pintool", "v", "1",
+                         "check every 16th result");
+
+typedef std::bitset<MAX_OFF> offs_t;
+
+// labels that threads hand to each other
+static lb_type shared_lb[NR_SHARED];
+
+typedef struct {
+  unsigned int seed;
+  size_t iters;
+  size_t fails;
+  PIN_THREAD_UID uid;
+} worker_t;
+
+static PIN_THREAD_UID driver_uid;
+static THREADID driver_tid = INVALID_THREADID;
+static size_t fails = 0;
+
+static bool add_offs(tag_seg const *seg, void *arg) {
+  offs_t &offs = *static_cast<offs_t *>(arg);
+  for (tag_off i = seg->begin; i < seg->end && i < MAX_OFF; i++)
+    offs.set(i);
+  return true;
+}
+
+static offs_t offs_of(lb_type lb) {
+  offs_t offs;
+  tag_visit(lb, add_offs, &offs);
+  return offs;
+}
+
+static VOID worker(VOID *arg) {
+  worker_t *w = static_cast<worker_t *>(arg);
+  bool const check = verify.Value();
+  lb_type mine[NR_MINE];
+  for (size_t i = 0; i < NR_MINE; i++)
+    mine[i] = tag_alloc<lb_type>(rand_r(&w->seed) % MAX_OFF);
+
+  for (size_t i = 0; i < w->iters; i++) {
+    unsigned int const r = rand_r(&w->seed);
+    lb_type const a = mine[r % NR_MINE];
+    lb_type const b =
+        (r & 0x100)
+            ? __atomic_load_n(&shared_lb[(r >> 9) % NR_SHARED],
+                              __ATOMIC_ACQUIRE)
+            : mine[(r >> 9) % NR_MINE];
+    lb_type const c = tag_combine(a, b);
+    if (check && (i & 15) == 0 && offs_of(c) != (offs_of(a) | offs_of(b)))
+      w->fails++;
+
+    // keep the sets small, so that new nodes keep coming
+    unsigned int const s = rand_r(&w->seed);
+    if ((s & 7) == 0)
+      mine[s % NR_MINE] = tag_alloc<lb_type>((s >> 3) % MAX_OFF);
+    else
+      mine[s % NR_MINE] = c;
+    if ((s & 0x30) == 0)
+      __atomic_store_n(&shared_lb[(s >> 6) % NR_SHARED], c, __ATOMIC_RELEASE);
+  }
+}
+
+static double now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// runs the rounds; the application goes on meanwhile
+static VOID driver(VOID *arg) {
+  UINT32 const max = nr_threads.Value();
+  worker_t *workers = new worker_t[max];
+  double base = 0;
+
+  for (UINT32 n = 1; n <= max; n *= 2) {
+    double const start = now_ms();
+    UINT32 started = 0;
+    for (; started < n; started++) {
+      worker_t *w = &workers[started];
+      w->seed = n * 1000 + started;
+      w->iters = nr_iters.Value() / n;
+      w->fails = 0;
+      if (PIN_SpawnInternalThread(worker, w, DEFAULT_THREAD_STACK_SIZE,
+                                  &w->uid) == INVALID_THREADID) {
+        printf("[BDD STRESS] FAIL: cannot start thread %u\n", started);
+        fails++;
+        break;
+      }
+    }
+    for (UINT32 i = 0; i < started; i++) {
+      PIN_WaitForThreadTermination(workers[i].uid, PIN_INFINITE_TIMEOUT, NULL);
+      fails += workers[i].fails;
+    }
+    double const ms = now_ms() - start;
+    if (n == 1)
+      base = ms;
+    printf("[BDD STRESS] %2u threads: %8.1f ms, speedup %.2f\n", n, ms,
+           base / ms);
+  }
+  delete[] workers;
+
+  printf("[BDD STRESS] %s (%lu failures)\n", fails ? "FAIL" : "OK", fails);
+  if (fails)
+    PIN_ExitProcess(1);
+}
+
+// the tool may not exit before the rounds are done
+static VOID driver_wait(VOID *v) {
+  if (driver_tid != INVALID_THREADID)
+    PIN_WaitForThreadTermination(driver_uid, PIN_INFINITE_TIMEOUT, NULL);
+}
+
+int main(int argc, char *argv[]) {
+
+  PIN_InitSymbols();
+
+  if (unlikely(PIN_Init(argc, argv))) {
+    std::cerr
+        << "Sth error in PIN_Init. Plz use the right command line options."
+        << std::endl;
+    return -1;
+  }
+
+  for (size_t i = 0; i < NR_SHARED; i++)
+    shared_lb[i] = tag_alloc<lb_type>(i % MAX_OFF);
+
+  driver_tid = PIN_SpawnInternalThread(driver, NULL, DEFAULT_THREAD_STACK_SIZE,
+                                       &driver_uid);
+  if (unlikely(driver_tid == INVALID_THREADID)) {
+    std::cerr << "Sth error starting the stress thread." << std::endl;
+    return -1;
+  }
+  PIN_AddPrepareForFiniFunction(driver_wait, NULL);
+
+  PIN_StartProgram();
+
+  return 0;
+}
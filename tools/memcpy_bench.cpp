@@ -0,0 +1,63 @@
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "time.h"
+
+// a memcpy-heavy target: the input taints a 32 MB buffer, whose blocks
+// are then copied around at random; the tag pages it needs are spread
+// over far more memory than the dTLB covers. Run it under a libdft tool
+// built with and without LIBDFT_HUGE_PAGES (make bench_hugepages does).
+
+#define BUF_SZ (32UL << 20)
+#define BLOCK_MAX (64UL << 10)
+#define NR_COPIES 20000
+
+static double now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2)
+    return 0;
+
+  FILE *fp = fopen(argv[1], "rb");
+  if (!fp) {
+    printf("st err\n");
+    return 0;
+  }
+  char seed[64];
+  size_t len = fread(seed, 1, sizeof seed, fp);
+  fclose(fp);
+  if (len == 0)
+    return 0;
+
+  char *buf = (char *)malloc(BUF_SZ);
+  if (!buf) {
+    printf("st err\n");
+    return 0;
+  }
+
+  double start = now_ms();
+  // spread the taint of the input over the whole buffer
+  memcpy(buf, seed, len);
+  for (size_t n = len; n < BUF_SZ; n *= 2)
+    memcpy(buf + n, buf, n < BUF_SZ - n ? n : BUF_SZ - n);
+  double fill = now_ms() - start;
+
+  unsigned int r = 1;
+  start = now_ms();
+  for (size_t i = 0; i < NR_COPIES; i++) {
+    size_t n = rand_r(&r) % BLOCK_MAX + 1;
+    size_t src = rand_r(&r) % (BUF_SZ - n);
+    size_t dst = rand_r(&r) % (BUF_SZ - n);
+    memmove(buf + dst, buf + src, n);
+  }
+  double copy = now_ms() - start;
+
+  printf("[MEMCPY BENCH] fill %.1f ms, %d copies %.1f ms (%d)\n", fill,
+         NR_COPIES, copy, buf[rand_r(&r) % BUF_SZ]);
+  free(buf);
+  return 0;
+}
@@ -0,0 +1,144 @@
+#include "branch_pred.h"
+#include "libdft_api.h"
+#include "pin.H"
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// times the tagmap API on the backend libdft was built with; run it once
+// per LIBDFT_TAGMAP value (make bench_tagmap does) to compare them
+//
+//   bulk       a tainted buffer copied around in blocks, as memcpy-heavy
+//              code propagates it
+//   bytes      the same copies a byte at a time, as the instrumentation
+//              of single-byte moves does
+//   scattered  every 64th byte tainted with one of NR_TAGS tags, read as
+//              words
+//
+// the tags are made before the clock starts; only the tagmap is timed
+
+#define BUF_SZ (1UL << 20)
+#define BLOCK_SZ (64UL << 10)
+#define SCATTER_SZ (16UL << 20)
+#define NR_TAGS 256
+
+static KNOB<UINT32> nr_rounds(KNOB_MODE_WRITEONCE, "pintool", "r", "16",
+                              "rounds of each workload");
+
+// the tags of these bytes are written; the bytes themselves never are
+static ADDRINT src_buf, dst_buf, scatter_buf;
+static tag_t block[BLOCK_SZ];
+static tag_t tags[NR_TAGS];
+static size_t fails = 0;
+
+#if LIBDFT_TAGMAP == libdft_tagmap_pagetable
+#define TAGMAP_NAME "pagetable"
+#elif LIBDFT_TAGMAP == libdft_tagmap_direct
+#define TAGMAP_NAME "direct"
+#else
+#define TAGMAP_NAME "interval"
+#endif
+
+static double now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void report(const char *what, double ms) {
+  tagmap_stats_t st;
+  tagmap_stats(&st);
+  printf("[TAGMAP BENCH] %-9s %-9s %9.1f ms, %6lu KB of shadow memory\n",
+         TAGMAP_NAME, what, ms, (unsigned long)(st.bytes_peak >> 10));
+}
+
+static void bench_bulk(UINT32 rounds) {
+  tagmap_setn(src_buf, BUF_SZ, tags[1]);
+  double const start = now_ms();
+  for (UINT32 r = 0; r < rounds; r++) {
+    for (size_t off = 0; off < BUF_SZ; off += BLOCK_SZ) {
+      tagmap_getn_tags(src_buf + off, BLOCK_SZ, block);
+      tagmap_setn_tags(dst_buf + off, BLOCK_SZ, block);
+    }
+    for (size_t off = 0; off < BUF_SZ; off += BLOCK_SZ)
+      tagmap_clrn(dst_buf + off, BLOCK_SZ);
+  }
+  report("bulk", now_ms() - start);
+  if (!tag_is_empty(tagmap_getn(dst_buf, BUF_SZ)))
+    fails++;
+  tagmap_clrn(src_buf, BUF_SZ);
+}
+
+static void bench_bytes(UINT32 rounds) {
+  tagmap_setn(src_buf, BLOCK_SZ, tags[2]);
+  double const start = now_ms();
+  for (UINT32 r = 0; r < rounds; r++)
+    for (size_t i = 0; i < BLOCK_SZ; i++)
+      tagmap_setb(dst_buf + i, tagmap_getb(src_buf + i));
+  report("bytes", now_ms() - start);
+  if (tag_is_empty(tagmap_getb(dst_buf + BLOCK_SZ - 1)))
+    fails++;
+  tagmap_clrn(src_buf, BLOCK_SZ);
+  tagmap_clrn(dst_buf, BLOCK_SZ);
+}
+
+static void bench_scattered(UINT32 rounds) {
+  double const start = now_ms();
+  for (size_t off = 0; off < SCATTER_SZ; off += 64)
+    tagmap_setb(scatter_buf + off, tags[(off >> 6) % NR_TAGS]);
+  size_t tainted = 0;
+  for (UINT32 r = 0; r < rounds; r++)
+    for (size_t off = 0; off < SCATTER_SZ; off += 8)
+      tainted += !tag_is_empty(tagmap_getn(scatter_buf + off, 8));
+  report("scattered", now_ms() - start);
+  if (tainted < rounds * (SCATTER_SZ / 64))
+    fails++;
+  tagmap_clrn(scatter_buf, SCATTER_SZ);
+}
+
+VOID EntryPoint(VOID *v) {
+  UINT32 const rounds = nr_rounds.Value();
+  for (size_t i = 0; i < NR_TAGS; i++)
+    tags[i] = tag_alloc<tag_t>(i);
+  bench_bulk(rounds);
+  bench_bytes(rounds);
+  bench_scattered(rounds);
+  printf("[TAGMAP BENCH] %s %s (%lu failures)\n", TAGMAP_NAME,
+         fails ? "FAIL" : "OK", fails);
+  if (fails)
+    PIN_ExitProcess(1);
+}
+
+int main(int argc, char *argv[]) {
+
+  PIN_InitSymbols();
+
+  if (unlikely(PIN_Init(argc, argv))) {
+    std::cerr
+        << "Sth error in PIN_Init. Plz use the right command line options."
+        << std::endl;
+    return -1;
+  }
+
+  if (unlikely(libdft_init() != 0)) {
+    std::cerr << "Sth error libdft_init." << std::endl;
+    return -1;
+  }
+
+  // address space no application byte can share tags with
+  void *mem = malloc(2 * BUF_SZ + SCATTER_SZ);
+  if (unlikely(mem == NULL)) {
+    std::cerr << "Sth error allocating the buffers." << std::endl;
+    return -1;
+  }
+  src_buf = (ADDRINT)mem;
+  dst_buf = src_buf + BUF_SZ;
+  scatter_buf = dst_buf + BUF_SZ;
+
+  PIN_AddApplicationStartFunction(EntryPoint, 0);
+
+  PIN_StartProgram();
+
+  return 0;
+}
@@ -0,0 +1,168 @@
+#include "branch_pred.h"
+#include "libdft_api.h"
+#include "pin.H"
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+// checks that tagmap_restore() brings back the tags of the snapshot, and
+// that the references to uniform pages are given back along the way:
+// after restores, a reset, and a full clear once the application is
+// threaded
+
+#define NR_PAGES 8
+// bytes a tag page covers
+#define TPG ((ADDRINT)PAGE_SIZE << LIBDFT_TAG_GRAN_BITS)
+// writes to one slot, enough to make the undo log squeeze itself
+#define NR_FLIPS 3000
+
+// the tags of these bytes are written; the bytes themselves never are
+static ADDRINT base;
+// the tag every byte should have
+static std::vector<tag_t> model;
+static std::vector<tag_t> tags_buf;
+static tag_t const cleared = tag_traits<tag_t>::cleared_val;
+static tag_t t1, t2, t3, ta, tb;
+static size_t fails = 0;
+
+static void check(bool ok, const char *what) {
+  if (unlikely(!ok)) {
+    printf("[TAGMAP SNAP] FAIL: %s\n", what);
+    fails++;
+  }
+}
+
+static void set(size_t page, size_t off, size_t n, tag_t tag) {
+  tagmap_setn(base + page * TPG + off, n, tag);
+  std::fill(model.begin() + page * TPG + off,
+            model.begin() + page * TPG + off + n, tag);
+}
+
+static void check_tags(const char *what) {
+  bool ok = true;
+  for (size_t page = 0; page < NR_PAGES; page++) {
+    tagmap_getn_tags(base + page * TPG, TPG, &tags_buf[0]);
+    for (size_t i = 0; i < TPG; i++)
+      ok &= tags_buf[i] == model[page * TPG + i];
+  }
+  check(ok, what);
+}
+
+#if LIBDFT_TAGMAP != libdft_tagmap_interval
+static void check_uniform(tagmap_stats_t const &want, const char *what) {
+  tagmap_stats_t st;
+  tagmap_stats(&st);
+  check(st.uniform_pages == want.uniform_pages &&
+            st.uniform_refs == want.uniform_refs,
+        what);
+}
+#else
+// no uniform pages; only the tags are checked
+static void check_uniform(tagmap_stats_t const &want, const char *what) {}
+#endif
+
+// every kind of slot change that a restore has to undo
+static void scribble(void) {
+  set(0, 0, TPG, t3);         // uniform to another uniform page
+  set(2, 128, 256, t3);       // a uniform page expanded to a private one
+  set(1, 0, TPG, cleared);    // a snapshot page cleared
+  set(3, 0, TPG, cleared);    // a uniform page cleared
+  set(4, 0, TPG, t1);         // a clean slot made uniform
+  set(5, 64, 64, t2);         // a clean slot made private
+  for (size_t i = 0; i < NR_FLIPS; i++)
+    set(6, 0, TPG, i & 1 ? ta : tb);
+  check_tags("writes after the snapshot");
+}
+
+VOID EntryPoint(VOID *v) {
+  t1 = tag_alloc<tag_t>(1);
+  t2 = tag_alloc<tag_t>(2);
+  t3 = tag_alloc<tag_t>(3);
+  ta = tag_alloc<tag_t>(10);
+  tb = tag_alloc<tag_t>(11);
+
+  tagmap_stats_t st0, st_snap;
+  tagmap_stats(&st0);
+
+  set(0, 0, TPG, t1);
+  set(1, 64, 1024, t2);
+  set(2, 0, TPG, t1);
+  set(3, 0, TPG, t2);
+  check_tags("writes before the snapshot");
+
+  tagmap_snapshot();
+  std::vector<tag_t> const snap_model = model;
+  tagmap_stats(&st_snap);
+
+  for (size_t round = 0; round < 2; round++) {
+    scribble();
+    tagmap_restore();
+    model = snap_model;
+    check_tags("tags after restore");
+    check_uniform(st_snap, "uniform references after restore");
+  }
+
+  tagmap_reset();
+  std::fill(model.begin(), model.end(), cleared);
+  check_tags("tags after reset");
+  check_uniform(st0, "uniform references after reset");
+#if LIBDFT_TAGMAP != libdft_tagmap_interval
+  tagmap_stats_t st;
+  tagmap_stats(&st);
+  check(st.pages == st0.pages, "pages left after reset");
+#endif
+
+  // once threaded, a full clear drops the reference in place of a copy
+  tagmap_set_threaded();
+  set(7, 0, TPG, t1);
+#if LIBDFT_TAGMAP != libdft_tagmap_interval
+  tagmap_stats(&st);
+  UINT64 const pages = st.pages;
+  UINT64 const refs = st.uniform_refs;
+  set(7, 0, TPG, cleared);
+  tagmap_stats(&st);
+  check(st.pages == pages && st.uniform_refs + 1 == refs,
+        "threaded clear of a uniform page");
+#else
+  set(7, 0, TPG, cleared);
+#endif
+  check_tags("tags after the threaded clear");
+
+  printf("[TAGMAP SNAP] %s (%lu failures)\n", fails ? "FAIL" : "OK", fails);
+  if (fails)
+    PIN_ExitProcess(1);
+}
+
+int main(int argc, char *argv[]) {
+
+  PIN_InitSymbols();
+
+  if (unlikely(PIN_Init(argc, argv))) {
+    std::cerr
+        << "Sth error in PIN_Init. Plz use the right command line options."
+        << std::endl;
+    return -1;
+  }
+
+  if (unlikely(libdft_init() != 0)) {
+    std::cerr << "Sth error libdft_init." << std::endl;
+    return -1;
+  }
+
+  // tag pages of their own, which no application byte shares
+  void *mem = malloc((NR_PAGES + 1) * TPG);
+  if (unlikely(mem == NULL)) {
+    std::cerr << "Sth error allocating the pages." << std::endl;
+    return -1;
+  }
+  base = ((ADDRINT)mem + TPG - 1) & ~(TPG - 1);
+  model.assign(NR_PAGES * TPG, cleared);
+  tags_buf.resize(TPG);
+
+  PIN_AddApplicationStartFunction(EntryPoint, 0);
+
+  PIN_StartProgram();
+
+  return 0;
+}